@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "OrderBook.h"
+
+static constexpr price_t ClosePrice = 50.0;
+static constexpr ticks_t TicksPerUnit = 100;
+// flow is spread over many traders as it would be in production, but rate
+// limits are lifted since they are not what these measure
+static constexpr int Traders = 65536;
+static constexpr size_t Batch = 1024;
+
+static Order makeOrder(Side side_, qty_t qty_, ticks_t ticks_) {
+  static int trader(0);
+  Order order(side_, qty_, static_cast<price_t>(ticks_) / TicksPerUnit);
+  order.settraderID(trader++ % Traders);
+  return order;
+}
+
+// cancels and amends come from the trader who sent the order, anyone else
+// is rejected
+static Order makeCancel(int orderID_, int traderID_, qty_t newQty_) {
+  Order request(Side::Buy, newQty_, 0);
+  request.setorderID(orderID_);
+  request.settraderID(traderID_);
+  return request;
+}
+
+static std::unique_ptr<OrderBook> makeBook(size_t maxOrders_) {
+  BookConfig config;
+  config.maxOrders = maxOrders_;
+  config.rateLimit.messagesPerSecond = 1e12;
+  config.rateLimit.burst = 1e12;
+  return std::make_unique<OrderBook>("BENCH", ClosePrice, config);
+}
+
+// Stands in for the exec report consumer so the ring never fills. Given the
+// benchmark's state it also checks that every request since the last drain
+// went through, and fails the benchmark rather than let it time rejects.
+static bool drainReports(OrderBook &book_,
+                         benchmark::State *state_ = nullptr) {
+  static ExecReport reports[Batch];
+  size_t count;
+  do {
+    count = book_.getExecMessages(reports, Batch);
+    for (size_t i(0); state_ && i < count; i++) {
+      if (reports[i].execType() == ExecType::Reject ||
+          reports[i].execType() == ExecType::CancelReject) {
+        state_->SkipWithError(reports[i].text());
+        return false;
+      }
+    }
+  } while (count == Batch);
+  return true;
+}
+
+static void reportLatency(benchmark::State &state_,
+                          std::vector<int64_t> &latencies_) {
+  if (latencies_.empty())
+    return;
+  std::sort(latencies_.begin(), latencies_.end());
+  auto percentile = [&latencies_](double p_) {
+    return static_cast<double>(
+        latencies_[static_cast<size_t>(p_ * (latencies_.size() - 1))]);
+  };
+  state_.counters["p50_ns"] = percentile(0.5);
+  state_.counters["p99_ns"] = percentile(0.99);
+  state_.counters["p99.9_ns"] = percentile(0.999);
+  state_.counters["max_ns"] = static_cast<double>(latencies_.back());
+}
+
+struct FlowOp {
+  bool isCancel;
+  Order order;
+};
+
+// Synthetic flow around the close: new order prices are normally distributed
+// with the given spread in ticks, so the inside levels both rest and cross.
+// cancelPercent_ of messages cancel or amend down an earlier order, which
+// may already have traded away.
+static std::vector<FlowOp> makeFlow(size_t count_, int cancelPercent_,
+                                    int spreadTicks_) {
+  std::mt19937 random(42);
+  std::normal_distribution<double> offset(0, spreadTicks_);
+  std::uniform_int_distribution<qty_t> qty(1, 100);
+  ticks_t close = static_cast<ticks_t>(ClosePrice * TicksPerUnit);
+  std::vector<FlowOp> flow;
+  std::vector<Order> sent;
+  flow.reserve(count_);
+  while (flow.size() < count_) {
+    if (not sent.empty() &&
+        static_cast<int>(random() % 100) < cancelPercent_) {
+      // every new order takes the next order ID, accepted or not
+      int orderID = 1 + random() % sent.size();
+      const Order &original = sent[orderID - 1];
+      qty_t newQty = random() % 2 ? 0 : original.ordQty() / 2;
+      flow.push_back(
+          {true, makeCancel(orderID, original.traderID(), newQty)});
+      continue;
+    }
+    Side side = random() % 2 ? Side::Buy : Side::Sell;
+    auto ticks = close + std::clamp<ticks_t>(std::lround(offset(random)),
+                                             -10 * TicksPerUnit,
+                                             10 * TicksPerUnit);
+    sent.push_back(makeOrder(side, qty(random), ticks));
+    flow.push_back({false, sent.back()});
+  }
+  return flow;
+}
+
+// Realistic mixed flow, one message per iteration. Args are the cancel
+// percentage and the price spread in ticks.
+static void BM_OrderFlow(benchmark::State &state_) {
+  const size_t flowSize = 100000;
+  auto flow = makeFlow(flowSize, state_.range(0), state_.range(1));
+  auto book = makeBook(flowSize);
+  std::vector<int64_t> latencies;
+  latencies.reserve(flowSize);
+  size_t next(0);
+  for (auto _ : state_) {
+    if (next == flow.size()) {
+      // replay the flow on a fresh book so order IDs line up again
+      state_.PauseTiming();
+      book = makeBook(flowSize);
+      next = 0;
+      state_.ResumeTiming();
+    }
+    FlowOp &op = flow[next++];
+    Order order = op.order;
+    auto start = std::chrono::steady_clock::now();
+    if (op.isCancel)
+      book->onOrderCancelRequest(order);
+    else
+      book->onOrderSingle(order);
+    auto end = std::chrono::steady_clock::now();
+    if (latencies.size() < latencies.capacity())
+      latencies.push_back((end - start).count());
+    if (next % Batch == 0)
+      drainReports(*book);
+  }
+  state_.SetItemsProcessed(state_.iterations());
+  reportLatency(state_, latencies);
+}
+BENCHMARK(BM_OrderFlow)
+    ->ArgNames({"cancel%", "spread"})
+    ->Args({0, 20})
+    ->Args({50, 20})
+    ->Args({90, 20})
+    ->Args({50, 200});
+
+// fills `levels_` bid levels below the close with `perLevel_` orders each
+static bool fillBids(benchmark::State &state_, OrderBook &book_, int levels_,
+                     int perLevel_) {
+  ticks_t close = static_cast<ticks_t>(ClosePrice * TicksPerUnit);
+  for (int level(0); level < levels_; level++)
+    for (int i(0); i < perLevel_; i++) {
+      Order order = makeOrder(Side::Buy, 10, close - 1 - level);
+      book_.onOrderSingle(order);
+    }
+  return drainReports(book_, &state_);
+}
+
+// Passive buys spread over a book already `depth` levels deep.
+static void BM_PassiveInsert(benchmark::State &state_) {
+  int depth = state_.range(0);
+  auto book = makeBook(65536);
+  if (not fillBids(state_, *book, depth, 10))
+    return;
+  ticks_t close = static_cast<ticks_t>(ClosePrice * TicksPerUnit);
+  std::vector<Order> orders;
+  for (size_t i(0); i < Batch; i++)
+    orders.push_back(makeOrder(Side::Buy, 10, close - 1 - i % depth));
+  std::vector<int> ids(Batch);
+  for (auto _ : state_) {
+    for (size_t i(0); i < Batch; i++) {
+      Order order = orders[i];
+      book->onOrderSingle(order);
+      ids[i] = order.orderID();
+    }
+    state_.PauseTiming();
+    for (size_t i(0); i < Batch; i++) {
+      Order cancel = makeCancel(ids[i], orders[i].traderID(), 0);
+      book->onOrderCancelRequest(cancel);
+    }
+    if (not drainReports(*book, &state_))
+      break;
+    state_.ResumeTiming();
+  }
+  state_.SetItemsProcessed(state_.iterations() * Batch);
+}
+BENCHMARK(BM_PassiveInsert)->Arg(1)->Arg(10)->Arg(100)->Arg(1000);
+
+// Cancels of resting orders in a book `depth` levels deep.
+static void BM_Cancel(benchmark::State &state_) {
+  int depth = state_.range(0);
+  auto book = makeBook(65536);
+  if (not fillBids(state_, *book, depth, 10))
+    return;
+  ticks_t close = static_cast<ticks_t>(ClosePrice * TicksPerUnit);
+  std::vector<Order> cancels(Batch);
+  for (auto _ : state_) {
+    state_.PauseTiming();
+    // also checks the previous iteration's cancels all went through
+    if (not drainReports(*book, &state_))
+      break;
+    for (size_t i(0); i < Batch; i++) {
+      Order order = makeOrder(Side::Buy, 10, close - 1 - i % depth);
+      book->onOrderSingle(order);
+      cancels[i] = makeCancel(order.orderID(), order.traderID(), 0);
+    }
+    if (not drainReports(*book, &state_))
+      break;
+    state_.ResumeTiming();
+    for (Order &cancel : cancels)
+      book->onOrderCancelRequest(cancel);
+  }
+  state_.SetItemsProcessed(state_.iterations() * Batch);
+}
+BENCHMARK(BM_Cancel)->Arg(1)->Arg(100)->Arg(1000);
+
+// Amends a resting order down by one lot per iteration.
+static void BM_AmendDown(benchmark::State &state_) {
+  auto book = makeBook(65536);
+  ticks_t close = static_cast<ticks_t>(ClosePrice * TicksPerUnit);
+  std::vector<Order> amends(Batch);
+  for (size_t i(0); i < Batch; i++) {
+    Order order = makeOrder(Side::Buy, 1000000000, close - 1 - i % 100);
+    book->onOrderSingle(order);
+    amends[i] = makeCancel(order.orderID(), order.traderID(), order.ordQty());
+  }
+  if (not drainReports(*book, &state_))
+    return;
+  size_t next(0);
+  for (auto _ : state_) {
+    Order &amend = amends[next++ % Batch];
+    amend.setordQty(amend.ordQty() - 1);
+    book->onOrderCancelRequest(amend);
+    if (next % Batch == 0 && not drainReports(*book, &state_))
+      break;
+  }
+  state_.SetItemsProcessed(state_.iterations());
+}
+BENCHMARK(BM_AmendDown);
+
+// One aggressive buy sweeping `levels` ask levels of five orders each.
+static void BM_AggressiveSweep(benchmark::State &state_) {
+  int levels = state_.range(0);
+  auto book = makeBook(65536);
+  ticks_t close = static_cast<ticks_t>(ClosePrice * TicksPerUnit);
+  for (auto _ : state_) {
+    state_.PauseTiming();
+    for (int level(0); level < levels; level++)
+      for (int i(0); i < 5; i++) {
+        Order order = makeOrder(Side::Sell, 10, close + level);
+        book->onOrderSingle(order);
+      }
+    if (not drainReports(*book, &state_))
+      break;
+    Order sweep = makeOrder(Side::Buy, levels * 50, close + levels);
+    state_.ResumeTiming();
+    book->onOrderSingle(sweep);
+  }
+  state_.SetItemsProcessed(state_.iterations());
+  state_.counters["fills"] = benchmark::Counter(
+      static_cast<double>(state_.iterations() * levels * 5),
+      benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_AggressiveSweep)->Arg(1)->Arg(10)->Arg(100);
+
+BENCHMARK_MAIN();
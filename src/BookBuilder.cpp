@@ -0,0 +1,78 @@
+#include "BookBuilder.h"
+
+void BookBuilder::apply(const OrderEvent &event_) {
+  if (event_.sequence != _sequence + 1) {
+    WARN("Order feed gap " << LOG_NVP("Expected", _sequence + 1)
+                           << LOG_NVP("Received", event_.sequence));
+    ++_gaps;
+  }
+  _sequence = event_.sequence;
+  switch (event_.type) {
+  case OrderEventType::Add: {
+    _orders[event_.orderID] =
+        RestingOrder{event_.side, event_.ticks, event_.qty};
+    Level &level = ladder(event_.side)[event_.ticks];
+    level.qty += event_.qty;
+    _positions[event_.orderID] =
+        level.queue.insert(level.queue.end(), event_.orderID);
+    break;
+  }
+  case OrderEventType::Modify: {
+    auto it = _orders.find(event_.orderID);
+    if (it != _orders.end())
+      reduce(event_.orderID, it->second.qty - event_.qty);
+    break;
+  }
+  case OrderEventType::Cancel:
+  case OrderEventType::Execute:
+    reduce(event_.orderID, event_.qty);
+    break;
+  default:
+    break;
+  }
+}
+
+void BookBuilder::reduce(int orderID_, qty_t qty_) {
+  auto it = _orders.find(orderID_);
+  if (it == _orders.end())
+    return;
+  RestingOrder &order = it->second;
+  Ladder &side = ladder(order.side);
+  auto level = side.find(order.ticks);
+  order.qty -= qty_;
+  level->second.qty -= qty_;
+  if (order.qty > 0)
+    return;
+  level->second.queue.erase(_positions[orderID_]);
+  if (level->second.queue.empty())
+    side.erase(level);
+  _positions.erase(orderID_);
+  _orders.erase(it);
+}
+
+const BookBuilder::RestingOrder *BookBuilder::order(int orderID_) const {
+  auto it = _orders.find(orderID_);
+  return it == _orders.end() ? nullptr : &it->second;
+}
+
+qty_t BookBuilder::qtyAt(Side side_, ticks_t ticks_) const {
+  auto &side = ladder(side_);
+  auto it = side.find(ticks_);
+  return it == side.end() ? 0 : it->second.qty;
+}
+
+std::vector<int> BookBuilder::queueAt(Side side_, ticks_t ticks_) const {
+  auto &side = ladder(side_);
+  auto it = side.find(ticks_);
+  if (it == side.end())
+    return {};
+  return {it->second.queue.begin(), it->second.queue.end()};
+}
+
+ticks_t BookBuilder::bestBid() const {
+  return _bids.empty() ? -1 : _bids.rbegin()->first;
+}
+
+ticks_t BookBuilder::bestAsk() const {
+  return _asks.empty() ? -1 : _asks.begin()->first;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <map>
+#include <vector>
+#include <unordered_map>
+
+#include "Domain.h"
+#include "OrderFeed.h"
+
+// Rebuilds a book's resting orders, in time priority, from its market by
+// order stream. Runs on the consumer side and is not thread safe. A hole in
+// the sequence numbers leaves the builder out of sync, its state is then a
+// best effort until it is rebuilt from scratch.
+class BookBuilder {
+public:
+  struct RestingOrder {
+    Side side;
+    ticks_t ticks;
+    qty_t qty;
+  };
+
+private:
+  struct Level {
+    qty_t qty = 0;
+    // order IDs in time priority
+    std::list<int> queue;
+  };
+
+  using Ladder = std::map<ticks_t, Level>;
+
+  std::unordered_map<int, RestingOrder> _orders;
+  std::unordered_map<int, std::list<int>::iterator> _positions;
+  Ladder _bids;
+  Ladder _asks;
+  uint64_t _sequence;
+  size_t _gaps;
+
+  Ladder &ladder(Side side_) { return side_ == Side::Buy ? _bids : _asks; }
+  const Ladder &ladder(Side side_) const {
+    return side_ == Side::Buy ? _bids : _asks;
+  }
+  void reduce(int orderID_, qty_t qty_);
+
+public:
+  BookBuilder() : _sequence(0), _gaps(0) {}
+
+  void apply(const OrderEvent &event_);
+
+  // last sequence applied
+  uint64_t sequence() const { return _sequence; }
+  bool inSync() const { return _gaps == 0; }
+  size_t gaps() const { return _gaps; }
+
+  size_t orderCount() const { return _orders.size(); }
+  const RestingOrder *order(int orderID_) const;
+  qty_t qtyAt(Side side_, ticks_t ticks_) const;
+  // resting order IDs at the level, in time priority
+  std::vector<int> queueAt(Side side_, ticks_t ticks_) const;
+  // -1 when the side is empty
+  ticks_t bestBid() const;
+  ticks_t bestAsk() const;
+};
@@ -0,0 +1,110 @@
+#include "BookSide.h"
+
+#include <iterator>
+
+BookSide::BookSide(Side side_, size_t window_, ticks_t anchor_,
+                   NodePool &farNodes_)
+    : _side(side_), _window(roundUp(window_)), _occupied(_window.size()),
+      _mask(_window.size() - 1), _base(anchor_ - target()),
+      _far(FarLevels::allocator_type(&farNodes_)), _best(npos) {}
+
+bool BookSide::isBetter(ticks_t ticks_, ticks_t than_) const {
+  return _side == Side::Buy ? ticks_ > than_ : ticks_ < than_;
+}
+
+// The window's slots run from slot(_base) up to the end of the ring and on
+// from the start of it, so a range of ticks is one run of slots from first
+// to last that may wrap around. Each search below looks at the part up to
+// the end of the ring and then at the part from its start.
+bool BookSide::inRun(size_t slot_, size_t first_, size_t last_) {
+  if (slot_ == LevelBitmap::npos)
+    return false;
+  return first_ <= last_ ? slot_ >= first_ && slot_ <= last_
+                         : slot_ >= first_ || slot_ <= last_;
+}
+
+ticks_t BookSide::windowAbove(ticks_t ticks_) const {
+  ticks_t from = std::max(ticks_ + 1, _base);
+  if (from >= windowEnd())
+    return npos;
+  size_t first = slot(from);
+  size_t last = slot(windowEnd() - 1);
+  size_t found = _occupied.atOrAbove(first);
+  if (first > last && found == LevelBitmap::npos)
+    found = _occupied.atOrAbove(0);
+  return inRun(found, first, last) ? slotTicks(found) : npos;
+}
+
+ticks_t BookSide::windowBelow(ticks_t ticks_) const {
+  ticks_t to = std::min(ticks_ - 1, windowEnd() - 1);
+  if (to < _base)
+    return npos;
+  size_t first = slot(_base);
+  size_t last = slot(to);
+  size_t found = _occupied.atOrBelow(last);
+  if (first > last && found == LevelBitmap::npos)
+    found = _occupied.atOrBelow(_mask);
+  return inRun(found, first, last) ? slotTicks(found) : npos;
+}
+
+ticks_t BookSide::nextAbove(ticks_t ticks_) const {
+  ticks_t found = windowAbove(ticks_);
+  auto far = _far.upper_bound(ticks_);
+  if (far != _far.end() && far->first < found)
+    found = far->first;
+  return found;
+}
+
+ticks_t BookSide::nextBelow(ticks_t ticks_) const {
+  ticks_t found = windowBelow(ticks_);
+  auto far = _far.lower_bound(ticks_);
+  if (far != _far.begin() && (found == npos || std::prev(far)->first > found))
+    found = std::prev(far)->first;
+  return found;
+}
+
+void BookSide::add(Order *order_) {
+  ticks_t ticks = order_->ticks();
+  PriceLevel *level;
+  if (inWindow(ticks)) {
+    level = &_window[slot(ticks)];
+    if (level->empty())
+      _occupied.set(slot(ticks));
+  } else {
+    level = &_far[ticks];
+  }
+  level->push(order_);
+  if (empty() || isBetter(ticks, _best))
+    _best = ticks;
+}
+
+void BookSide::remove(Order *order_) {
+  PriceLevel *level = order_->level();
+  if (!level)
+    return;
+  level->erase(order_);
+  if (not level->empty())
+    return;
+  ticks_t ticks = order_->ticks();
+  if (inWindow(ticks))
+    _occupied.clear(slot(ticks));
+  else
+    _far.erase(ticks);
+  if (ticks == _best)
+    _best = _side == Side::Buy ? nextBelow(ticks) : nextAbove(ticks);
+}
+
+PriceLevel &BookSide::evict(ticks_t ticks_) {
+  size_t index = slot(ticks_);
+  PriceLevel &level = _far[ticks_];
+  level.takeFrom(_window[index]);
+  _occupied.clear(index);
+  return level;
+}
+
+BookSide::FarLevels::iterator BookSide::admit(FarLevels::iterator level_) {
+  size_t index = slot(level_->first);
+  _window[index].takeFrom(level_->second);
+  _occupied.set(index);
+  return _far.erase(level_);
+}
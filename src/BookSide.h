@@ -0,0 +1,138 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <map>
+#include <vector>
+
+#include "Domain.h"
+#include "LevelBitmap.h"
+#include "NodePool.h"
+#include "PriceLevel.h"
+
+// One side of the book: a ladder of price levels keyed by ticks with the best
+// (highest bid / lowest ask) level tracked as orders come and go.
+//
+// Levels near the touch live in a dense window, a ring of slots indexed by
+// ticks modulo its size, so they are found with a mask and the next best is
+// found through an occupancy bitmap without walking the ladder. Levels
+// outside the window are held sparsely in an ordered map, only while they
+// have orders. Memory is then bounded by the window and the resting orders,
+// whatever the instrument's price range or tick size. Every far level holds
+// an order, so there are never more of them than the book has orders, and
+// their map nodes come from a pool preallocated to that bound rather than
+// from the heap as the market moves. The book recenters the
+// window once the best drifts too far from where the window wants it, moving
+// the levels that change sides along with their orders.
+class BookSide {
+  using FarLevels =
+      std::map<ticks_t, PriceLevel, std::less<ticks_t>,
+               PoolAllocator<std::pair<const ticks_t, PriceLevel>>>;
+
+  Side _side;
+  std::vector<PriceLevel> _window;
+  LevelBitmap _occupied;
+  size_t _mask;
+  // lowest ticks in the window
+  ticks_t _base;
+  FarLevels _far;
+  ticks_t _best;
+
+  static size_t roundUp(size_t capacity_) {
+    size_t size(1);
+    while (size < capacity_)
+      size <<= 1;
+    return size;
+  }
+  size_t slot(ticks_t ticks_) const {
+    return static_cast<size_t>(ticks_) & _mask;
+  }
+  ticks_t slotTicks(size_t slot_) const {
+    return _base + static_cast<ticks_t>((slot_ - slot(_base)) & _mask);
+  }
+  ticks_t windowEnd() const {
+    return _base + static_cast<ticks_t>(_window.size());
+  }
+  // where the best sits after recentering: bids keep three quarters of the
+  // window below the best, asks three quarters above it
+  ticks_t target() const {
+    ticks_t size = static_cast<ticks_t>(_window.size());
+    return _side == Side::Buy ? size - size / 4 : size / 4;
+  }
+  bool isBetter(ticks_t ticks_, ticks_t than_) const;
+  static bool inRun(size_t slot_, size_t first_, size_t last_);
+  ticks_t windowAbove(ticks_t ticks_) const;
+  ticks_t windowBelow(ticks_t ticks_) const;
+  PriceLevel &evict(ticks_t ticks_);
+  FarLevels::iterator admit(FarLevels::iterator level_);
+
+public:
+  static constexpr ticks_t npos = std::numeric_limits<ticks_t>::max();
+  // a far level's map node: the level plus the tree's colour and three links
+  static constexpr size_t FarNodeSize =
+      sizeof(FarLevels::value_type) + 4 * sizeof(void *);
+
+  // window_ is rounded up to a power of two and first placed as if the best
+  // were at anchor_. Far levels take FarNodeSize blocks from farNodes_,
+  // which may be shared with the other side.
+  BookSide(Side side_, size_t window_, ticks_t anchor_, NodePool &farNodes_);
+
+  Side side() const { return _side; }
+  bool empty() const { return _best == npos; }
+  ticks_t bestTicks() const { return _best; }
+  PriceLevel *best() { return empty() ? nullptr : level(_best); }
+  size_t windowSize() const { return _window.size(); }
+  bool inWindow(ticks_t ticks_) const {
+    return ticks_ >= _base && ticks_ < windowEnd();
+  }
+  // levels held outside the window
+  size_t farLevels() const { return _far.size(); }
+
+  // null for a price outside the window with no orders
+  PriceLevel *level(ticks_t ticks_) {
+    if (inWindow(ticks_))
+      return &_window[slot(ticks_)];
+    auto far = _far.find(ticks_);
+    return far == _far.end() ? nullptr : &far->second;
+  }
+  const PriceLevel *level(ticks_t ticks_) const {
+    return const_cast<BookSide *>(this)->level(ticks_);
+  }
+  // nearest level with orders strictly above / below ticks_, npos if none
+  ticks_t nextAbove(ticks_t ticks_) const;
+  ticks_t nextBelow(ticks_t ticks_) const;
+
+  // at the order's ticks
+  void add(Order *order_);
+  void remove(Order *order_);
+
+  // whether the best has left the middle of the window, only checked
+  // between requests so no level moves while the book holds on to it
+  bool offCenter() const {
+    if (empty())
+      return false;
+    ticks_t offset = _best - _base;
+    ticks_t size = static_cast<ticks_t>(_window.size());
+    return _side == Side::Buy ? offset < size / 4 || offset >= size
+                              : offset < 0 || offset >= size - size / 4;
+  }
+  // Slides the window back to the best. Each level that moves out of or
+  // into the window is handed to moved_(ticks, level, inWindow) as it
+  // moves, in its new place.
+  template <typename Fn> void recenter(Fn &&moved_) {
+    ticks_t base = _best - target();
+    ticks_t size = static_cast<ticks_t>(_window.size());
+    ticks_t from = base > _base ? _base : std::max(base + size, _base);
+    ticks_t to = base > _base ? std::min(base, windowEnd()) : windowEnd();
+    for (ticks_t ticks = windowAbove(from - 1); ticks < to;
+         ticks = windowAbove(ticks))
+      moved_(ticks, evict(ticks), false);
+    _base = base;
+    for (auto far = _far.lower_bound(base);
+         far != _far.end() && far->first < windowEnd();) {
+      ticks_t ticks = far->first;
+      far = admit(far);
+      moved_(ticks, _window[slot(ticks)], true);
+    }
+  }
+};
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+// raw reading of CycleClock, only meaningful as a difference
+using cycles_t = uint64_t;
+
+// Cheap monotonic clock for latency measurement. Reads the TSC where there
+// is one, which costs a few nanoseconds against a clock_gettime call, and
+// converts to nanoseconds with a rate calibrated once against steady_clock.
+// Elsewhere it falls back to steady_clock nanoseconds.
+class CycleClock {
+  static double calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+    auto start = std::chrono::steady_clock::now();
+    cycles_t startCycles = now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    cycles_t endCycles = now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+    return static_cast<double>(elapsed.count()) / (endCycles - startCycles);
+#else
+    return 1.0;
+#endif
+  }
+
+public:
+  static cycles_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+  }
+
+  static double nanosPerCycle() {
+    static const double rate = calibrate();
+    return rate;
+  }
+
+  static uint64_t toNanos(cycles_t cycles_) {
+    return static_cast<uint64_t>(cycles_ * nanosPerCycle());
+  }
+
+  // nanoseconds from start_ to now, zero if start_ was never stamped
+  static uint64_t nanosSince(cycles_t start_) {
+    cycles_t end = now();
+    return start_ == 0 || end < start_ ? 0 : toNanos(end - start_);
+  }
+};
+
+// Monotonic nanoseconds read once per loop iteration by the thread that owns
+// it and cached, for checks such as rate limits that are fine with a coarse
+// view of time and run too often to read the clock themselves. Only the
+// owning thread updates it, other threads may read it.
+class CoarseClock {
+  std::atomic<uint64_t> _nanos;
+
+public:
+  CoarseClock() : _nanos(0) { update(); }
+  void update() {
+    _nanos.store(CycleClock::toNanos(CycleClock::now()),
+                 std::memory_order_relaxed);
+  }
+  uint64_t nanos() const { return _nanos.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,127 @@
+#include "DepthFeed.h"
+
+#include <algorithm>
+
+DepthFeed::DepthFeed(DepthFeedMode mode_, size_t window_,
+                     ticks_t ticksPerUnit_, size_t capacity_)
+    : _mode(mode_), _window(window_), _ticksPerUnit(ticksPerUnit_),
+      _levels(new Level[2 * window_]), _best{npos, npos}, _sequence(0),
+      _updates(capacity_),
+      // every slot queued at most once, so this ring never fills
+      _changed(mode_ == DepthFeedMode::Conflated ? 2 * window_ : 1),
+      _dropped(0) {}
+
+void DepthFeed::write(Level &slot_, ticks_t ticks_, qty_t qty_,
+                      size_t count_, uint64_t sequence_) {
+  uint32_t version = slot_.version.load(std::memory_order_relaxed);
+  slot_.version.store(version + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot_.ticks.store(ticks_, std::memory_order_relaxed);
+  slot_.qty.store(qty_, std::memory_order_relaxed);
+  slot_.count.store(static_cast<uint32_t>(count_), std::memory_order_relaxed);
+  slot_.sequence.store(sequence_, std::memory_order_relaxed);
+  slot_.version.store(version + 2, std::memory_order_release);
+}
+
+void DepthFeed::queue(const LevelUpdate &update_) {
+  if (not _updates.tryPush(update_))
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void DepthFeed::publish(Side side_, ticks_t ticks_, qty_t qty_, size_t count_,
+                        ticks_t best_, bool mirrored_) {
+  size_t index = slot(ticks_);
+  Level &slot = level(side_, index);
+  uint64_t sequence = ++_sequence;
+  ticks_t held = slot.ticks.load(std::memory_order_relaxed);
+  if (mirrored_) {
+    // a level that emptied before the window moved on may still be queued
+    // under this slot, its last state goes out before the slot is reused
+    if (_mode == DepthFeedMode::Conflated && held != ticks_ && held != npos)
+      queue(read(side_, index));
+    write(slot, ticks_, qty_, count_, sequence);
+  } else if (held == ticks_) {
+    // the level has just left the window
+    write(slot, npos, 0, 0, sequence);
+  }
+  _best[static_cast<int>(side_)].store(best_, std::memory_order_release);
+
+  if (_mode == DepthFeedMode::Incremental ||
+      (_mode == DepthFeedMode::Conflated && not mirrored_)) {
+    LevelUpdate update;
+    update.sequence = sequence;
+    update.side = side_;
+    update.ticks = ticks_;
+    update.price = static_cast<price_t>(ticks_) / _ticksPerUnit;
+    update.qty = qty_;
+    update.count = static_cast<uint32_t>(count_);
+    queue(update);
+  } else if (_mode == DepthFeedMode::Conflated &&
+             not slot.pending.exchange(true, std::memory_order_acq_rel)) {
+    _changed.tryPush(static_cast<uint32_t>(index * 2 +
+                                           static_cast<int>(side_)));
+  }
+}
+
+LevelUpdate DepthFeed::read(Side side_, size_t slot_) const {
+  const Level &slot = level(side_, slot_);
+  LevelUpdate update;
+  update.side = side_;
+  uint32_t before, after;
+  do {
+    before = slot.version.load(std::memory_order_acquire);
+    update.ticks = slot.ticks.load(std::memory_order_relaxed);
+    update.qty = slot.qty.load(std::memory_order_relaxed);
+    update.count = slot.count.load(std::memory_order_relaxed);
+    update.sequence = slot.sequence.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = slot.version.load(std::memory_order_relaxed);
+  } while (before != after || (before & 1));
+  update.price = static_cast<price_t>(update.ticks) / _ticksPerUnit;
+  return update;
+}
+
+size_t DepthFeed::poll(LevelUpdate *out_, size_t max_) {
+  // Conflated only queues levels outside the window here, and the last
+  // state of levels whose slot was reused
+  size_t count = _updates.popBatch(out_, max_);
+  if (_mode != DepthFeedMode::Conflated)
+    return count;
+  uint32_t key;
+  while (count < max_ && _changed.tryPop(key)) {
+    auto side = static_cast<Side>(key & 1);
+    size_t index = key / 2;
+    // cleared first, a change landing after this queues the level again
+    level(side, index).pending.store(false, std::memory_order_seq_cst);
+    LevelUpdate update = read(side, index);
+    // the level left the window, its last state went through the ring
+    if (update.ticks != npos)
+      out_[count++] = update;
+  }
+  return count;
+}
+
+DepthSnapshot DepthFeed::snapshot(size_t levels_) const {
+  DepthSnapshot snapshot;
+  snapshot.bids.reserve(levels_);
+  snapshot.asks.reserve(levels_);
+  auto collect = [&](Side side_, std::vector<LevelUpdate> &out_) {
+    bool isBuy = side_ == Side::Buy;
+    ticks_t best = _best[isBuy ? 0 : 1].load(std::memory_order_acquire);
+    if (best == npos)
+      return;
+    // only the window is mirrored, a slot holding another level is empty
+    // at this price
+    for (size_t i(0); i < _window && out_.size() < levels_; i++) {
+      ticks_t ticks = isBuy ? best - static_cast<ticks_t>(i)
+                            : best + static_cast<ticks_t>(i);
+      LevelUpdate update = read(side_, slot(ticks));
+      if (update.ticks == ticks && update.qty > 0)
+        out_.push_back(update);
+      snapshot.sequence = std::max(snapshot.sequence, update.sequence);
+    }
+  };
+  collect(Side::Buy, snapshot.bids);
+  collect(Side::Sell, snapshot.asks);
+  return snapshot;
+}
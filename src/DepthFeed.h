@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "Domain.h"
+#include "SpscRing.h"
+
+// Incremental queues every level change, and drops changes (counting them)
+// when the consumer falls a full ring behind. Conflated queues each changed
+// level near the touch at most once and hands the consumer the level's
+// latest state, so it never falls behind on them.
+ENUM_MACRO_3(DepthFeedMode, Off, Incremental, Conflated)
+
+struct LevelUpdate {
+  // feed wide, increases with every change the book makes
+  uint64_t sequence = 0;
+  Side side = Side::Unknown;
+  ticks_t ticks = 0;
+  price_t price = 0;
+  // aggregate quantity and order count, zero once the level empties
+  qty_t qty = 0;
+  uint32_t count = 0;
+};
+
+struct DepthSnapshot {
+  uint64_t sequence = 0;
+  // best first
+  std::vector<LevelUpdate> bids;
+  std::vector<LevelUpdate> asks;
+};
+
+// Market by price feed for one book. The book's writer thread publishes and
+// never waits on the consumer. Besides the update channel the feed mirrors
+// the levels in the window of each side of the book, each behind its own
+// seqlock, which any thread can read for a top of book snapshot. Levels
+// outside the window are not mirrored, so Conflated passes their changes on
+// through the update ring as they come, where they drop like Incremental
+// ones if the consumer falls a full ring behind.
+class DepthFeed {
+public:
+  static constexpr ticks_t npos = std::numeric_limits<ticks_t>::max();
+
+private:
+  struct Level {
+    std::atomic<uint32_t> version{0};
+    // the level the slot mirrors, npos while it mirrors none
+    std::atomic<ticks_t> ticks{npos};
+    std::atomic<qty_t> qty{0};
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint64_t> sequence{0};
+    // queued for the consumer and not yet read, Conflated only
+    std::atomic<bool> pending{false};
+  };
+
+  DepthFeedMode _mode;
+  // slots per side, indexed by ticks modulo the window like the book's
+  size_t _window;
+  ticks_t _ticksPerUnit;
+  // buy levels then sell levels
+  std::unique_ptr<Level[]> _levels;
+  std::atomic<ticks_t> _best[2];
+  uint64_t _sequence;
+  SpscRing<LevelUpdate> _updates;
+  // level keys, slot * 2 + side
+  SpscRing<uint32_t> _changed;
+  std::atomic<size_t> _dropped;
+
+  size_t slot(ticks_t ticks_) const {
+    return static_cast<size_t>(ticks_) & (_window - 1);
+  }
+  Level &level(Side side_, size_t slot_) const {
+    return _levels[static_cast<int>(side_) * _window + slot_];
+  }
+  LevelUpdate read(Side side_, size_t slot_) const;
+  void write(Level &slot_, ticks_t ticks_, qty_t qty_, size_t count_,
+             uint64_t sequence_);
+  void queue(const LevelUpdate &update_);
+
+public:
+  // window_ is the book's window, a power of two. capacity_ bounds the
+  // update ring, Conflated sizes its own level queue.
+  DepthFeed(DepthFeedMode mode_, size_t window_, ticks_t ticksPerUnit_,
+            size_t capacity_);
+  DepthFeed(const DepthFeed &) = delete;
+  DepthFeed &operator=(const DepthFeed &) = delete;
+
+  // writer side. mirrored_ is whether the level is in its side's window,
+  // best_ the side's best ticks or npos when it is empty. A level moving
+  // out of or into the window is published again as it moves.
+  void publish(Side side_, ticks_t ticks_, qty_t qty_, size_t count_,
+               ticks_t best_, bool mirrored_);
+
+  // consumer side, a single thread
+  size_t poll(LevelUpdate *out_, size_t max_);
+
+  // any thread. Levels are each read consistently, but levels changing
+  // while the snapshot is taken may come from either side of the change.
+  DepthSnapshot snapshot(size_t levels_) const;
+
+  DepthFeedMode mode() const { return _mode; }
+  // updates lost to a full ring, take a snapshot to recover
+  size_t dropped() const { return _dropped; }
+};
@@ -1,17 +1,34 @@
 #include "Domain.h"
 #include "Utils.h"
+#include <cstring>
+#include <iterator>
 #include <ostream>
 
-std::ostream &operator<<(std::ostream &is_, const Order::Ptr &order_) {
-  is_ << LOG_NVP("Price", order_->price())
-      << LOG_NVP("OrdQty", order_->ordQty())
-      << LOG_NVP("Side", enum2str(order_->side()))
-      << LOG_NVP("LeavesQty", order_->leavesQty())
-      << LOG_NVP("CumQty", order_->cumQty())
-      << LOG_NVP("LastQty", order_->lastQty())
-      << LOG_NVP("LastPrice", order_->lastPrice())
-      << LOG_NVP("OrdStatus", enum2str(order_->side()))
-      << LOG_NVP("OrderID", order_->orderID())
-      << LOG_NVP("TraderID", order_->traderID());
+bool ExecText::same(const char *text_, const char *other_) {
+  return text_ == other_ or std::strcmp(text_, other_) == 0;
+}
+
+uint8_t ExecText::encode(const char *text_) {
+  // rejects are rare, a scan is cheaper than hashing every report's text
+  for (size_t i(0); i < std::size(All); i++)
+    if (same(text_, All[i]))
+      return static_cast<uint8_t>(i);
+  return 0;
+}
+
+const char *ExecText::decode(uint8_t code_) {
+  return code_ < std::size(All) ? All[code_] : None;
+}
+
+std::ostream &operator<<(std::ostream &is_, const Order &order_) {
+  is_ << LOG_NVP("Price", order_.price()) << LOG_NVP("OrdQty", order_.ordQty())
+      << LOG_NVP("Side", enum2str(order_.side()))
+      << LOG_NVP("LeavesQty", order_.leavesQty())
+      << LOG_NVP("CumQty", order_.cumQty())
+      << LOG_NVP("LastQty", order_.lastQty())
+      << LOG_NVP("LastPrice", order_.lastPrice())
+      << LOG_NVP("OrdStatus", enum2str(order_.side()))
+      << LOG_NVP("OrderID", order_.orderID())
+      << LOG_NVP("TraderID", order_.traderID());
   return is_;
 }
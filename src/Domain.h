@@ -1,6 +1,9 @@
 #pragma once
+#include "Clock.h"
 #include "Utils.h"
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <ctime>
 #include <memory>
 #include <string>
@@ -14,37 +17,58 @@ using timestamp_t = std::chrono::time_point<std::chrono::system_clock>;
 
 using qty_t = long;
 using price_t = double;
+// prices inside the book are integer multiples of the tick size
+using ticks_t = long;
+
+class PriceLevel;
 
 class Order {
   Side _side;
   OrdStatus _status;
   qty_t _ordQty;
   price_t _price;
+  ticks_t _ticks;
   std::string _symbol;
-  timestamp_t _entryTime;
+  // when the book was handed the order, for latency measurement
+  cycles_t _entryCycles;
   int _orderID;
   qty_t _cumQty;
   price_t _lastPrice;
+  ticks_t _lastTicks;
   qty_t _lastQty;
   int _traderID;
+  // intrusive links into the resting queue of a price level
+  Order *_prev;
+  Order *_next;
+  PriceLevel *_level;
+
+  friend class PriceLevel;
 
 public:
-  using Ptr = std::shared_ptr<Order>;
+  // orders are owned by the book's pool, handles are plain pointers
+  using Ptr = Order *;
   Order(Side side_, qty_t ordQty_, price_t price_)
       : _side(side_), _status(OrdStatus::PendingNew), _ordQty(ordQty_),
-        _price(price_), _symbol("TEST"), _entryTime(), _orderID(), _cumQty(0),
-        _lastPrice(0), _lastQty(0), _traderID(0) {}
+        _price(price_), _ticks(0), _symbol(), _entryCycles(0), _orderID(),
+        _cumQty(0), _lastPrice(0), _lastTicks(0), _lastQty(0), _traderID(0),
+        _prev(nullptr),
+        _next(nullptr), _level(nullptr) {}
+  Order() : Order(Side::Unknown, 0, 0) {}
 
-  OrdStatus status() { return _status; }
+  OrdStatus status() const { return _status; }
   void setstatus(OrdStatus newStatus_) { _status = newStatus_; }
   price_t price() const { return _price; }
+  ticks_t ticks() const { return _ticks; }
+  void setticks(ticks_t ticks_) { _ticks = ticks_; }
   Side side() const { return _side; }
   int orderID() const { return _orderID; }
   void setorderID(int oid_) { _orderID = oid_; }
+  const std::string &symbol() const { return _symbol; }
+  void setsymbol(std::string symbol_) { _symbol = std::move(symbol_); }
   int traderID() const { return _traderID; }
   void settraderID(int traderID_) { _traderID = traderID_; }
-  void setEntryTimeNow() { _entryTime = std::chrono::system_clock::now(); }
-  timestamp_t entryTime() { return _entryTime; }
+  void setEntryTimeNow() { _entryCycles = CycleClock::now(); }
+  cycles_t entryCycles() const { return _entryCycles; }
 
   qty_t ordQty() const { return _ordQty; }
   void setordQty(qty_t newQty_) { _ordQty = newQty_; }
@@ -53,8 +77,10 @@ public:
   qty_t leavesQty() const { return _ordQty - _cumQty; }
 
   price_t lastPrice() const { return _lastPrice; }
-  void setlastPrice(price_t price_) {
+  ticks_t lastTicks() const { return _lastTicks; }
+  void setlastPrice(ticks_t ticks_, price_t price_) {
     // handle average price here also
+    _lastTicks = ticks_;
     _lastPrice = price_;
   }
   qty_t lastQty() const { return _lastQty; }
@@ -62,87 +88,168 @@ public:
     _cumQty += qty_;
     _lastQty = qty_;
   }
+  // for restoring an order whose fills have already been counted
+  void restoreFills(qty_t cumQty_, qty_t lastQty_) {
+    _cumQty = cumQty_;
+    _lastQty = lastQty_;
+  }
 
   bool isCancelled() const { return _status == OrdStatus::Cancelled; }
+
+  PriceLevel *level() const { return _level; }
+  bool isResting() const { return _level != nullptr; }
+  Order *next() const { return _next; }
 };
 
-ENUM_MACRO_6(ExecType, New, Trade, Cancel, Reject, CancelReject, Replaced)
+// Phase reports belong to no order, they journal the book moving between
+// trading phases
+ENUM_MACRO_7(ExecType, New, Trade, Cancel, Reject, CancelReject, Replaced,
+             Phase)
+
+// Every text the book puts on an exec report. Reports only ever point at one
+// of these, so the binary journal can store the text as an index into All.
+struct ExecText {
+  static constexpr const char *None = "";
+  static constexpr const char *PriceNotTickAligned =
+      "Order_price_is_not_multiple_of_ticksize";
+  static constexpr const char *PriceOutsideThreshold =
+      "Order_price_is_outside_threshold_of_closePrice";
+  static constexpr const char *RateExceeded = "Message_rate_exceeded";
+  static constexpr const char *CapacityExceeded = "Order_capacity_exceeded";
+  static constexpr const char *TraderNotRegistered = "Trader_not_registered.";
+  static constexpr const char *OrderNotFound = "Order_not_found.";
+  static constexpr const char *AmendUpNotAllowed =
+      "Quantity_amend_up_is_not_allowed";
+  static constexpr const char *TooLateToCancel = "Too_late_to_cancel";
+  static constexpr const char *TraderOutOfRange = "Trader_id_out_of_range";
+  static constexpr const char *AuctionStarted = "Auction_started";
+  static constexpr const char *AuctionUncrossed = "Auction_uncrossed";
+  static constexpr const char *QtyNotPositive =
+      "Order_quantity_must_be_positive";
+
+  static constexpr const char *All[] = {
+      None,          PriceNotTickAligned, PriceOutsideThreshold,
+      RateExceeded,  CapacityExceeded,    TraderNotRegistered,
+      OrderNotFound, AmendUpNotAllowed,   TooLateToCancel,
+      TraderOutOfRange, AuctionStarted,  AuctionUncrossed,
+      QtyNotPositive};
+
+  // by content, a literal may have a different address in each translation
+  // unit
+  static bool same(const char *text_, const char *other_);
+  // unknown text encodes as None
+  static uint8_t encode(const char *text_);
+  // out of range codes decode as None
+  static const char *decode(uint8_t code_);
+};
+
+struct ExecRecord;
 
 class ExecReport {
   ExecType _execType;
   price_t _price;
+  ticks_t _ticks;
   qty_t _ordQty;
   OrdStatus _ordStatus;
+  Side _side;
   int _orderID;
+  int _traderID;
   int _execID;
+  // tells apart books publishing into one stream
+  uint32_t _bookID;
 
   qty_t _lastQty;
   qty_t _cumQty;
   price_t _lastPrice;
-  std::string _text;
+  ticks_t _lastTicks;
+  // always a string literal, reports are copied around by value
+  const char *_text;
   timestamp_t _timestamp;
+  cycles_t _createdCycles;
+
+  friend struct ExecRecord;
 
 public:
-  using Ptr = std::shared_ptr<ExecReport>;
-  ExecReport(const Order::Ptr &order_, ExecType execType_)
-      : _execType(execType_), _price(order_->price()),
-        _ordQty(order_->ordQty()), _ordStatus(order_->status()),
-        _orderID(order_->orderID()), _execID(0), _lastQty(order_->lastQty()),
-        _cumQty(order_->cumQty()), _lastPrice(order_->lastPrice()), _text(""),
-        _timestamp(std::chrono::system_clock::now()) {}
+  using Ptr = ExecReport *;
+  ExecReport()
+      : _execType(ExecType::Unknown), _price(0), _ticks(0), _ordQty(0),
+        _ordStatus(OrdStatus::Unknown), _side(Side::Unknown), _orderID(0),
+        _traderID(0), _execID(0), _bookID(0),
+        _lastQty(0), _cumQty(0), _lastPrice(0), _lastTicks(0), _text(""),
+        _timestamp(), _createdCycles(0) {}
+  ExecReport(const Order &order_, ExecType execType_)
+      : _execType(execType_), _price(order_.price()), _ticks(order_.ticks()),
+        _ordQty(order_.ordQty()), _ordStatus(order_.status()),
+        _side(order_.side()), _orderID(order_.orderID()),
+        _traderID(order_.traderID()), _execID(0), _bookID(0),
+        _lastQty(order_.lastQty()),
+        _cumQty(order_.cumQty()), _lastPrice(order_.lastPrice()),
+        _lastTicks(order_.lastTicks()), _text(""),
+        _timestamp(std::chrono::system_clock::now()),
+        _createdCycles(CycleClock::now()) {}
 
   int orderID() const { return _orderID; }
+  Side side() const { return _side; }
+  int traderID() const { return _traderID; }
   qty_t ordQty() const { return _ordQty; }
   price_t price() const { return _price; }
+  ticks_t ticks() const { return _ticks; }
   int execID() const { return _execID; }
+  void setexecID(int execID_) { _execID = execID_; }
+  uint32_t bookID() const { return _bookID; }
+  void setbookID(uint32_t bookID_) { _bookID = bookID_; }
   ExecType execType() const { return _execType; }
   OrdStatus ordStatus() const { return _ordStatus; }
   price_t lastPrice() const { return _lastPrice; }
+  ticks_t lastTicks() const { return _lastTicks; }
   qty_t lastQty() const { return _lastQty; }
   qty_t cumQty() const { return _cumQty; }
-  void settext(const std::string &text_) { _text = text_; }
-  const std::string &text() const { return _text; }
+  void settext(const char *text_) { _text = text_; }
+  const char *text() const { return _text; }
   timestamp_t timestamp() const { return _timestamp; }
+  cycles_t createdCycles() const { return _createdCycles; }
 };
 
 // std::ostream& operator << (std::ostream& is_, const ExecReport::Ptr&
 // execRep_);
 
+// per trader message limit, enforced as a token bucket
+struct RateLimit {
+  // tokens added a second
+  double messagesPerSecond = 100;
+  // most tokens a trader can bank, i.e. the largest burst allowed
+  double burst = 100;
+};
+
+// A slot in the book's trader table. Every message takes a token, tokens
+// refill continuously at the limit's rate, so a trader may burst up to the
+// bucket size and is then held to the sustained rate.
 class Trader {
-  int _messageCount;
-  timestamp_t _lastMessageTime;
+  double _tokens;
+  uint64_t _refilledAt;
+  bool _registered;
 
 public:
-  using Ptr = std::shared_ptr<Trader>;
-  Trader()
-      : _messageCount(0), _lastMessageTime(std::chrono::system_clock::now()) {}
+  Trader() : _tokens(0), _refilledAt(0), _registered(false) {}
 
-  void resetMessageCount() {
-    _lastMessageTime = std::chrono::system_clock::now();
-    _messageCount = 0;
+  bool isRegistered() const { return _registered; }
+  void registerAt(uint64_t nowNanos_, const RateLimit &limit_) {
+    _registered = true;
+    _tokens = limit_.burst;
+    _refilledAt = nowNanos_;
   }
 
-  bool isRateExceeded() {
-    auto elapsed = std::chrono::system_clock::now() - _lastMessageTime;
-    if (elapsed < std::chrono::seconds(1)) {
-      if (++_messageCount > 100)
-        return true;
-    } else {
-      resetMessageCount();
-    }
-    return false;
-  }
-};
-
-class OrderCompare {
-public:
-  bool operator()(const Order::Ptr &self_, const Order::Ptr &other_) {
-    if (almost_equal(self_->price(), other_->price())) {
-      // favour orders entered before other orders
-      return self_->entryTime() > other_->entryTime();
+  // takes a token, false if the bucket is empty
+  bool tryConsume(uint64_t nowNanos_, const RateLimit &limit_) {
+    if (nowNanos_ > _refilledAt) {
+      _tokens = std::min(limit_.burst,
+                         _tokens + (nowNanos_ - _refilledAt) * 1e-9 *
+                                       limit_.messagesPerSecond);
+      _refilledAt = nowNanos_;
     }
-    return (self_->side() == Side::Buy)
-               ? less_than(self_->price(), other_->price())
-               : greater_than(self_->price(), other_->price());
+    if (_tokens < 1)
+      return false;
+    _tokens -= 1;
+    return true;
   }
 };
@@ -0,0 +1,69 @@
+#include "ExecJournal.h"
+
+#include <algorithm>
+#include <cstring>
+
+JournalHeader JournalHeader::make(const std::string &symbol_,
+                                  ticks_t ticksPerUnit_) {
+  JournalHeader header{};
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.recordSize = sizeof(ExecRecord);
+  header.ticksPerUnit = ticksPerUnit_;
+  // always leave room for the terminator
+  std::memcpy(header.symbol, symbol_.data(),
+              std::min(symbol_.size(), sizeof(header.symbol) - 1));
+  return header;
+}
+
+bool JournalHeader::isValid() const {
+  return std::memcmp(magic, Magic, sizeof(Magic)) == 0 &&
+         version == Version && recordSize == sizeof(ExecRecord) &&
+         ticksPerUnit > 0;
+}
+
+ExecRecord ExecRecord::encode(const ExecReport &report_) {
+  ExecRecord record{};
+  record.sequence = static_cast<uint64_t>(report_._execID);
+  record.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         report_._timestamp.time_since_epoch())
+                         .count();
+  record.ticks = report_._ticks;
+  record.lastTicks = report_._lastTicks;
+  record.ordQty = report_._ordQty;
+  record.cumQty = report_._cumQty;
+  record.lastQty = report_._lastQty;
+  record.orderID = report_._orderID;
+  record.traderID = report_._traderID;
+  record.execType = static_cast<uint8_t>(report_._execType);
+  record.ordStatus = static_cast<uint8_t>(report_._ordStatus);
+  record.text = ExecText::encode(report_._text);
+  record.side = static_cast<uint8_t>(report_._side);
+  return record;
+}
+
+ExecReport ExecRecord::decode(ticks_t ticksPerUnit_) const {
+  ExecReport report;
+  report._execID = static_cast<int>(sequence);
+  std::chrono::nanoseconds sinceEpoch(timestamp);
+  report._timestamp = timestamp_t(
+      std::chrono::duration_cast<timestamp_t::duration>(sinceEpoch));
+  report._ticks = ticks;
+  report._price = static_cast<price_t>(ticks) / ticksPerUnit_;
+  report._lastTicks = lastTicks;
+  report._lastPrice = static_cast<price_t>(lastTicks) / ticksPerUnit_;
+  report._ordQty = ordQty;
+  report._cumQty = cumQty;
+  report._lastQty = lastQty;
+  report._orderID = orderID;
+  report._traderID = traderID;
+  // a damaged record must not index past the enum name tables
+  report._execType = static_cast<ExecType>(
+      std::min<int>(execType, static_cast<int>(ExecType::Unknown)));
+  report._ordStatus = static_cast<OrdStatus>(
+      std::min<int>(ordStatus, static_cast<int>(OrdStatus::Unknown)));
+  report._side =
+      static_cast<Side>(std::min<int>(side, static_cast<int>(Side::Unknown)));
+  report._text = ExecText::decode(text);
+  return report;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+
+#include "Domain.h"
+
+// how ExecWriter lays out the exec journal
+ENUM_MACRO_2(JournalFormat, Text, Binary)
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "binary journal records are written in host byte order");
+
+// First bytes of a binary journal. Records carry prices as ticks, the header
+// holds what is needed to turn them back into prices.
+struct JournalHeader {
+  static constexpr char Magic[8] = {'O', 'B', 'E', 'X', 'E', 'C', 'J', '1'};
+  // 2 added the side and trader, which journal recovery needs, 3 the phase
+  // reports
+  static constexpr uint32_t Version = 3;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+  int64_t ticksPerUnit;
+  char symbol[16];
+
+  static JournalHeader make(const std::string &symbol_, ticks_t ticksPerUnit_);
+  bool isValid() const;
+};
+
+// One exec report in a binary journal, copied straight out of the report
+// with no formatting. The sequence is the report's exec ID. Records carry
+// everything needed to rebuild the book from the journal.
+struct ExecRecord {
+  uint64_t sequence;
+  // nanoseconds since the epoch
+  int64_t timestamp;
+  int64_t ticks;
+  int64_t lastTicks;
+  int64_t ordQty;
+  int64_t cumQty;
+  int64_t lastQty;
+  int32_t orderID;
+  int32_t traderID;
+  uint8_t execType;
+  uint8_t ordStatus;
+  // index into ExecText::All
+  uint8_t text;
+  uint8_t side;
+  uint32_t reserved;
+
+  static ExecRecord encode(const ExecReport &report_);
+  ExecReport decode(ticks_t ticksPerUnit_) const;
+};
+
+static_assert(sizeof(JournalHeader) == 40, "journal header layout changed");
+static_assert(sizeof(ExecRecord) == 72, "journal record layout changed");
@@ -1,58 +1,124 @@
 #include "ExecWriter.h"
-#include <sstream>
 
-ExecWriter::ExecWriter(OrderBook::Ptr orderBook_)
-    : _orderBookPtr(std::move(orderBook_)), _fileHandle(),
-      _fileLocation("./" + _orderBookPtr->symbol() + "_exec_report.log"),
-      _batchSize(5), _batch() {}
+ExecWriter::ExecWriter(OrderBook::Ptr orderBook_, const JournalConfig &config_)
+    : _orderBookPtr(std::move(orderBook_)), _config(config_),
+      _fileLocation(config_.path.empty()
+                        ? "./" + _orderBookPtr->symbol() + "_exec_report.log"
+                        : config_.path),
+      _journal(_fileLocation, config_.bufferSize), _line(),
+      _batch(config_.drainBatch), _running(false), _written(0), _syncs(0),
+      _failures(0), _unsynced(false),
+      _lastSync(std::chrono::steady_clock::now()), _reportToJournal() {
+  // appending to an existing binary journal reuses its header
+  if (_config.format == JournalFormat::Binary && _journal.isEmpty()) {
+    auto header = JournalHeader::make(_orderBookPtr->symbol(),
+                                      _orderBookPtr->ticksPerUnit());
+    _journal.sputn(reinterpret_cast<const char *>(&header), sizeof(header));
+  }
+}
 
-ExecWriter::~ExecWriter() {
-  _orderBookPtr = nullptr;
-  _writerThread.join();
-  writeBatch();
-  _fileHandle.close();
+ExecWriter::~ExecWriter() { stop(); }
+
+void ExecWriter::write(const ExecReport &message) {
+  std::streamsize size, written;
+  if (_config.format == JournalFormat::Binary) {
+    auto record = ExecRecord::encode(message);
+    size = sizeof(record);
+    written = _journal.sputn(reinterpret_cast<const char *>(&record), size);
+  } else {
+    formatText(_line, message);
+    size = static_cast<std::streamsize>(_line.size());
+    written = _journal.sputn(_line.data(), size);
+  }
+  if (written != size) {
+    ERROR("Exec report lost from journal "
+          << LOG_NVP("ExecID", message.execID())
+          << LOG_NVP("Path", _fileLocation));
+    ++_failures;
+  }
 }
 
-std::string ExecWriter::formatTime(timestamp_t time_) {
-  auto outTime = std::chrono::system_clock::to_time_t(time_);
-  std::stringstream ss;
-  ss << std::put_time(std::localtime(&outTime), "%Y-%m-%d:%X");
-  return ss.str();
+void ExecWriter::formatText(LineFormatter &line_, const ExecReport &message_) {
+  line_.clear();
+  line_.field("ExecType", message_.execType())
+      .field("OrdStatus", message_.ordStatus())
+      .field("CumQty", message_.cumQty())
+      .field("OrdQty", message_.ordQty())
+      .field("LastPrice", message_.lastPrice())
+      .field("LastQty", message_.lastQty())
+      .field("OrderID", message_.orderID())
+      .field("Text", message_.text())
+      .field("TimeStamp", message_.timestamp())
+      .append('\n');
 }
 
-void ExecWriter::write(const ExecReport::Ptr &message) {
-  _fileHandle << LOG_NVP("ExecType", enum2str(message->execType()))
-              << LOG_NVP("OrdStatus", enum2str(message->ordStatus()))
-              << LOG_NVP("CumQty", message->cumQty())
-              << LOG_NVP("OrdQty", message->ordQty())
-              << LOG_NVP("LastPrice", message->lastPrice())
-              << LOG_NVP("LastQty", message->lastQty())
-              << LOG_NVP("OrderID", message->orderID())
-              << LOG_NVP("Text", message->text())
-              << LOG_NVP("TimeStamp", formatTime(message->timestamp()))
-              << std::endl;
+size_t ExecWriter::drain() {
+  size_t total(0);
+  for (;;) {
+    size_t count = _orderBookPtr->getExecMessages(_batch.data(), _batch.size());
+    for (size_t i(0); i < count; i++) {
+      write(_batch[i]);
+      _reportToJournal.record(
+          CycleClock::nanosSince(_batch[i].createdCycles()));
+    }
+    total += count;
+    // a short read means we have caught up with the book
+    if (count < _batch.size())
+      break;
+  }
+  if (total) {
+    _written += total;
+    _unsynced = true;
+    commit(false);
+  }
+  return total;
 }
 
-void ExecWriter::writeBatch() {
-  _fileHandle.open(_fileLocation, std::ios::app);
-  for (auto &message : _batch)
-    write(message);
-  _fileHandle.close();
-  _batch.clear();
+// A failed flush keeps its bytes buffered and a failed sync leaves the
+// reports owed to disk, so both are retried on the next commit.
+void ExecWriter::commit(bool force_) {
+  bool flushed = _journal.flush();
+  if (not flushed) {
+    ERROR("Journal flush failed " << LOG_NVP("Path", _fileLocation)
+                                  << LOG_NVP("Buffered", _journal.buffered()));
+    ++_failures;
+  }
+  if (_config.durability == Durability::None || not _unsynced)
+    return;
+  auto now = std::chrono::steady_clock::now();
+  if (force_ || _config.durability == Durability::EveryBatch ||
+      now - _lastSync >= _config.syncInterval) {
+    // retried at the next interval rather than on every idle pass
+    _lastSync = now;
+    if (not flushed || not _journal.syncToDisk()) {
+      ERROR("Journal not synced to disk " << LOG_NVP("Path", _fileLocation));
+      ++_failures;
+      return;
+    }
+    _unsynced = false;
+    ++_syncs;
+  }
 }
 
 void ExecWriter::main() {
-  while (_orderBookPtr) {
-    ExecReport::Ptr message = _orderBookPtr->getExecMessage();
-    if (message) {
-      _batch.emplace_back(message);
+  while (_running) {
+    if (drain() == 0) {
+      // idle, but a periodic sync may still be owed for earlier writes
+      commit(false);
+      std::this_thread::sleep_for(_config.idleSleep);
     }
-    if (_batch.size() >= _batchSize)
-      writeBatch();
-    std::this_thread::sleep_for(std::chrono::seconds(1));
   }
+  drain();
+  commit(true);
 }
 
 void ExecWriter::start() {
+  _running = true;
   _writerThread = std::thread(&ExecWriter::main, this);
 }
+
+void ExecWriter::stop() {
+  _running = false;
+  if (_writerThread.joinable())
+    _writerThread.join();
+}
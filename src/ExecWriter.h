@@ -1,31 +1,78 @@
 #ifndef EXECWRITER_H
 #define EXECWRITER_H
-#include <fstream>
+#include <atomic>
+#include <chrono>
 #include <thread>
 
 #include "Domain.h"
+#include "ExecJournal.h"
+#include "JournalFile.h"
+#include "LatencyHistogram.h"
+#include "LineFormatter.h"
 #include "OrderBook.h"
 
+// when written reports are forced to disk. Periodic and EveryBatch both
+// group commit, one fsync covers every report written since the last one.
+ENUM_MACRO_3(Durability, None, Periodic, EveryBatch)
+
+struct JournalConfig {
+  // defaults to ./<symbol>_exec_report.log
+  std::string path;
+  // Binary writes fixed size ExecRecords, decode them with journal_decode
+  JournalFormat format = JournalFormat::Text;
+  size_t bufferSize = 1 << 20;
+  // reports popped from the book per read
+  size_t drainBatch = 1024;
+  Durability durability = Durability::None;
+  std::chrono::milliseconds syncInterval{100};
+  // how long to back off when the book has nothing to write
+  std::chrono::microseconds idleSleep{200};
+};
+
 class ExecWriter {
 
 private:
   OrderBook::Ptr _orderBookPtr;
-  std::ofstream _fileHandle;
+  JournalConfig _config;
   std::string _fileLocation;
-  size_t _batchSize;
-  std::vector<ExecReport::Ptr> _batch;
+  JournalFile _journal;
+  LineFormatter _line;
+  std::vector<ExecReport> _batch;
+  std::atomic<bool> _running;
   std::thread _writerThread;
+  std::atomic<size_t> _written;
+  std::atomic<size_t> _syncs;
+  std::atomic<size_t> _failures;
+  bool _unsynced;
+  std::chrono::steady_clock::time_point _lastSync;
+  LatencyHistogram _reportToJournal;
 
 private:
   void main();
-  void write(const ExecReport::Ptr &message);
-  void writeBatch();
-  static std::string formatTime(timestamp_t time_);
+  void write(const ExecReport &message);
+  size_t drain();
+  void commit(bool force_);
 
 public:
-  explicit ExecWriter(OrderBook::Ptr orderBook_);
+  explicit ExecWriter(OrderBook::Ptr orderBook_,
+                      const JournalConfig &config_ = JournalConfig());
   ~ExecWriter();
   void start();
+  // writes out everything already published by the book before returning
+  void stop();
+
+  // the text journal line for one report, including the newline
+  static void formatText(LineFormatter &line_, const ExecReport &message_);
+
+  const std::string &fileLocation() const { return _fileLocation; }
+  size_t written() const { return _written; }
+  size_t syncs() const { return _syncs; }
+  // reports that could not be buffered plus failed flushes and syncs. Once
+  // nonzero the journal no longer holds everything the book reported, and
+  // trading should stop.
+  size_t failures() const { return _failures; }
+  // nanoseconds from the book creating a report to it entering the journal
+  const LatencyHistogram &reportToJournal() const { return _reportToJournal; }
 };
 
 #endif // EXECWRITER_H
@@ -0,0 +1,89 @@
+#include "JournalFile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Utils.h"
+
+JournalFile::JournalFile(const std::string &path_, size_t bufferSize_)
+    : _fd(::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644)),
+      _buffer(bufferSize_) {
+  if (_fd < 0)
+    ERROR("Failed to open journal " << LOG_VAR(path_)
+                                    << LOG_NVP("Error", std::strerror(errno)));
+  setp(_buffer.data(), _buffer.data() + _buffer.size());
+}
+
+JournalFile::~JournalFile() {
+  flush();
+  if (_fd >= 0)
+    ::close(_fd);
+}
+
+size_t JournalFile::writeAll(const char *data_, size_t size_) {
+  if (_fd < 0)
+    return 0;
+  size_t total(0);
+  while (total < size_) {
+    ssize_t written = ::write(_fd, data_ + total, size_ - total);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("Journal write failed " << LOG_NVP("Error", std::strerror(errno)));
+      break;
+    }
+    total += written;
+  }
+  return total;
+}
+
+bool JournalFile::isEmpty() const {
+  struct stat info;
+  if (_fd < 0 || ::fstat(_fd, &info) != 0)
+    return false;
+  return info.st_size == 0 && pptr() == pbase();
+}
+
+bool JournalFile::flush() {
+  size_t pending = buffered();
+  size_t written = writeAll(pbase(), pending);
+  std::memmove(_buffer.data(), pbase() + written, pending - written);
+  setp(_buffer.data(), _buffer.data() + _buffer.size());
+  pbump(static_cast<int>(pending - written));
+  return written == pending;
+}
+
+bool JournalFile::syncToDisk() {
+  if (not flush())
+    return false;
+  if (::fdatasync(_fd) != 0) {
+    ERROR("Journal sync failed " << LOG_NVP("Error", std::strerror(errno)));
+    return false;
+  }
+  return true;
+}
+
+int JournalFile::overflow(int ch_) {
+  if (not flush())
+    return traits_type::eof();
+  if (not traits_type::eq_int_type(ch_, traits_type::eof()))
+    sputc(traits_type::to_char_type(ch_));
+  return traits_type::not_eof(ch_);
+}
+
+std::streamsize JournalFile::xsputn(const char *data_,
+                                    std::streamsize size_) {
+  if (size_ > epptr() - pptr()) {
+    if (not flush())
+      return 0;
+    // larger than the whole buffer, skip the copy
+    if (size_ > epptr() - pptr())
+      return static_cast<std::streamsize>(writeAll(data_, size_));
+  }
+  std::memcpy(pptr(), data_, size_);
+  pbump(static_cast<int>(size_));
+  return size_;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// Append only file behind a large user space buffer, usable as the streambuf
+// of a std::ostream. Bytes reach the kernel when the buffer fills or on
+// flush(), and are only forced to disk by syncToDisk(). Bytes a failed write
+// did not get to the kernel stay buffered for the next flush.
+class JournalFile : public std::streambuf {
+  int _fd;
+  std::vector<char> _buffer;
+
+public:
+  JournalFile(const std::string &path_, size_t bufferSize_);
+  ~JournalFile() override;
+  JournalFile(const JournalFile &) = delete;
+  JournalFile &operator=(const JournalFile &) = delete;
+
+  bool isOpen() const { return _fd >= 0; }
+  // nothing on disk and nothing buffered
+  bool isEmpty() const;
+  // bytes not yet handed to the kernel
+  size_t buffered() const { return pptr() - pbase(); }
+  bool flush();
+  bool syncToDisk();
+
+protected:
+  int overflow(int ch_) override;
+  std::streamsize xsputn(const char *data_, std::streamsize size_) override;
+  int sync() override { return flush() ? 0 : -1; }
+
+private:
+  // how much of data_ reached the kernel, all of it unless a write failed
+  size_t writeAll(const char *data_, size_t size_);
+};
@@ -0,0 +1,58 @@
+#include "LatencyHistogram.h"
+
+#include <cmath>
+
+#include "Utils.h"
+
+uint64_t LatencyHistogram::percentile(double fraction_) const {
+  uint64_t total(0);
+  uint64_t counts[Buckets];
+  for (size_t i(0); i < Buckets; i++)
+    total += counts[i] = _counts[i].load(std::memory_order_relaxed);
+  if (total == 0)
+    return 0;
+  auto target = static_cast<uint64_t>(std::ceil(fraction_ * total));
+  uint64_t seen(0);
+  for (size_t i(0); i < Buckets; i++) {
+    seen += counts[i];
+    if (seen >= std::max<uint64_t>(target, 1))
+      return std::min(bucketTop(i), max());
+  }
+  return max();
+}
+
+void LatencyDump::dump() const {
+  for (auto &entry : _entries) {
+    auto &histogram = *entry.histogram;
+    INFO("Latency " << LOG_NVP("Name", entry.name)
+                    << LOG_NVP("Count", histogram.count())
+                    << LOG_NVP("Mean", histogram.mean())
+                    << LOG_NVP("P50", histogram.percentile(0.5))
+                    << LOG_NVP("P99", histogram.percentile(0.99))
+                    << LOG_NVP("P99.9", histogram.percentile(0.999))
+                    << LOG_NVP("Max", histogram.max()));
+  }
+}
+
+void LatencyDump::main() {
+  auto next = std::chrono::steady_clock::now() + _interval;
+  while (_running) {
+    // short naps so stop() does not wait out a whole interval
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (std::chrono::steady_clock::now() < next)
+      continue;
+    dump();
+    next += _interval;
+  }
+}
+
+void LatencyDump::start() {
+  _running = true;
+  _thread = std::thread(&LatencyDump::main, this);
+}
+
+void LatencyDump::stop() {
+  _running = false;
+  if (_thread.joinable())
+    _thread.join();
+}
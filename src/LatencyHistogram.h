@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Log linear histogram of nanosecond latencies, in the style of
+// HdrHistogram: values are bucketed by power of two and each power of two is
+// split into 16 linear sub buckets, so any value is kept to within 1/16th.
+// The buckets are a fixed array, recording never allocates. One thread
+// records, any thread may read.
+class LatencyHistogram {
+  static constexpr int SubBits = 4;
+  static constexpr uint64_t SubBuckets = 1 << SubBits;
+  static constexpr size_t Buckets = (64 - SubBits + 1) * SubBuckets;
+
+  std::atomic<uint64_t> _counts[Buckets];
+  std::atomic<uint64_t> _count;
+  std::atomic<uint64_t> _sum;
+  std::atomic<uint64_t> _max;
+
+  static size_t bucketOf(uint64_t value_) {
+    if (value_ < SubBuckets)
+      return value_;
+    int shift = 63 - __builtin_clzll(value_) - SubBits;
+    return (shift + 1) * SubBuckets + ((value_ >> shift) & (SubBuckets - 1));
+  }
+  // largest value that lands in bucket_
+  static uint64_t bucketTop(size_t bucket_) {
+    if (bucket_ < SubBuckets)
+      return bucket_;
+    int shift = bucket_ / SubBuckets - 1;
+    uint64_t bottom = (SubBuckets + bucket_ % SubBuckets) << shift;
+    return bottom + ((uint64_t(1) << shift) - 1);
+  }
+  // single writer, so a plain load and store is enough
+  static void bump(std::atomic<uint64_t> &counter_, uint64_t by_) {
+    counter_.store(counter_.load(std::memory_order_relaxed) + by_,
+                   std::memory_order_relaxed);
+  }
+
+public:
+  LatencyHistogram() : _counts(), _count(0), _sum(0), _max(0) {}
+  LatencyHistogram(const LatencyHistogram &) = delete;
+  LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+  void record(uint64_t nanos_) {
+    bump(_counts[bucketOf(nanos_)], 1);
+    bump(_count, 1);
+    bump(_sum, nanos_);
+    if (nanos_ > _max.load(std::memory_order_relaxed))
+      _max.store(nanos_, std::memory_order_relaxed);
+  }
+
+  uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+  uint64_t max() const { return _max.load(std::memory_order_relaxed); }
+  double mean() const {
+    uint64_t count = this->count();
+    return count ? static_cast<double>(_sum.load()) / count : 0;
+  }
+  // upper bound of the bucket holding the given fraction, e.g. 0.99
+  uint64_t percentile(double fraction_) const;
+};
+
+// Periodically logs a summary line per registered histogram.
+class LatencyDump {
+  struct Entry {
+    std::string name;
+    const LatencyHistogram *histogram;
+  };
+
+  std::vector<Entry> _entries;
+  std::chrono::milliseconds _interval;
+  std::atomic<bool> _running;
+  std::thread _thread;
+
+  void main();
+
+public:
+  explicit LatencyDump(std::chrono::milliseconds interval_)
+      : _entries(), _interval(interval_), _running(false), _thread() {}
+  ~LatencyDump() { stop(); }
+
+  // histograms must outlive the dump, add them all before start()
+  void add(std::string name_, const LatencyHistogram &histogram_) {
+    _entries.push_back({std::move(name_), &histogram_});
+  }
+  void dump() const;
+  void start();
+  void stop();
+};
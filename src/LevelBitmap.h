@@ -0,0 +1,97 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Occupancy bitmap over a ladder of price levels. Above the bit per level
+// sit summary layers with a bit per non zero word of the layer below, up to
+// a single top word, so the nearest occupied level in either direction is
+// found with one count-zeros instruction per layer.
+class LevelBitmap {
+  static constexpr size_t WordBits = 64;
+
+  // _layers[0] holds a bit per level, the last layer is a single word
+  std::vector<std::vector<uint64_t>> _layers;
+
+  static uint64_t bit(size_t index_) { return uint64_t(1) << (index_ % 64); }
+
+  // first set bit at or after pos_ in layer_
+  size_t findNext(size_t layer_, size_t pos_) const {
+    auto &words = _layers[layer_];
+    size_t word = pos_ / WordBits;
+    if (word >= words.size())
+      return npos;
+    uint64_t mask = words[word] & (~uint64_t(0) << (pos_ % WordBits));
+    if (mask == 0) {
+      if (layer_ + 1 == _layers.size())
+        return npos;
+      word = findNext(layer_ + 1, word + 1);
+      if (word == npos)
+        return npos;
+      mask = words[word];
+    }
+    return word * WordBits + __builtin_ctzll(mask);
+  }
+
+  // last set bit at or before pos_ in layer_
+  size_t findPrev(size_t layer_, size_t pos_) const {
+    auto &words = _layers[layer_];
+    size_t word = pos_ / WordBits;
+    uint64_t mask = words[word] & (~uint64_t(0) >> (63 - pos_ % WordBits));
+    if (mask == 0) {
+      if (word == 0 || layer_ + 1 == _layers.size())
+        return npos;
+      word = findPrev(layer_ + 1, word - 1);
+      if (word == npos)
+        return npos;
+      mask = words[word];
+    }
+    return word * WordBits + 63 - __builtin_clzll(mask);
+  }
+
+public:
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  explicit LevelBitmap(size_t size_) {
+    size_t words = (size_ + WordBits - 1) / WordBits;
+    do {
+      _layers.emplace_back(std::max<size_t>(words, 1), 0);
+      words = (words + WordBits - 1) / WordBits;
+    } while (_layers.back().size() > 1);
+  }
+
+  bool test(size_t index_) const {
+    return _layers[0][index_ / WordBits] & bit(index_);
+  }
+
+  void set(size_t index_) {
+    for (auto &words : _layers) {
+      uint64_t &word = words[index_ / WordBits];
+      bool wasEmpty = word == 0;
+      word |= bit(index_);
+      if (not wasEmpty)
+        break;
+      index_ /= WordBits;
+    }
+  }
+
+  void clear(size_t index_) {
+    for (auto &words : _layers) {
+      uint64_t &word = words[index_ / WordBits];
+      word &= ~bit(index_);
+      if (word != 0)
+        break;
+      index_ /= WordBits;
+    }
+  }
+
+  // nearest set index strictly above / below index_, npos if there is none
+  size_t nextAbove(size_t index_) const { return findNext(0, index_ + 1); }
+  size_t nextBelow(size_t index_) const {
+    return index_ == 0 ? npos : findPrev(0, index_ - 1);
+  }
+  // the same, counting index_ itself
+  size_t atOrAbove(size_t index_) const { return findNext(0, index_); }
+  size_t atOrBelow(size_t index_) const { return findPrev(0, index_); }
+};
@@ -0,0 +1,41 @@
+#include "LineFormatter.h"
+
+#include <algorithm>
+#include <cstring>
+
+LineFormatter::LineFormatter()
+    : _buffer(), _size(0), _cachedSecond(-1), _secondPrefix(),
+      _prefixSize(0) {}
+
+LineFormatter &LineFormatter::append(std::string_view text_) {
+  size_t count = std::min(text_.size(), Capacity - _size);
+  std::memcpy(_buffer + _size, text_.data(), count);
+  _size += count;
+  return *this;
+}
+
+LineFormatter &LineFormatter::append(char char_) {
+  if (_size < Capacity)
+    _buffer[_size++] = char_;
+  return *this;
+}
+
+LineFormatter &LineFormatter::appendTime(timestamp_t time_) {
+  using namespace std::chrono;
+  auto sinceEpoch = duration_cast<nanoseconds>(time_.time_since_epoch());
+  auto second = floor<seconds>(sinceEpoch);
+  if (second.count() != _cachedSecond) {
+    _cachedSecond = second.count();
+    std::tm local;
+    localtime_r(&_cachedSecond, &local);
+    _prefixSize = std::strftime(_secondPrefix, sizeof(_secondPrefix),
+                                "%Y-%m-%d:%H:%M:%S", &local);
+  }
+  append(std::string_view(_secondPrefix, _prefixSize)).append('.');
+  // fixed width so the digits read as a fraction
+  char digits[9];
+  auto nanos = (sinceEpoch - second).count();
+  for (int i(8); i >= 0; i--, nanos /= 10)
+    digits[i] = static_cast<char>('0' + nanos % 10);
+  return append(std::string_view(digits, sizeof(digits)));
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <charconv>
+#include <cstddef>
+#include <ctime>
+#include <string_view>
+#include <type_traits>
+
+#include "Domain.h"
+
+// Builds one text line at a time in a fixed buffer without touching the heap.
+// Numbers go through std::to_chars, enums through their enum2sv tables.
+// Timestamps render as local time with nanoseconds,
+// 2024-01-31:13:45:07.123456789, and the part up to the second is only
+// rendered again when the second changes.
+class LineFormatter {
+  static constexpr size_t Capacity = 1024;
+
+  char _buffer[Capacity];
+  size_t _size;
+  std::time_t _cachedSecond;
+  char _secondPrefix[32];
+  size_t _prefixSize;
+
+  template <typename T> LineFormatter &appendNumber(T value_) {
+    auto result = std::to_chars(_buffer + _size, _buffer + Capacity, value_);
+    if (result.ec == std::errc())
+      _size = result.ptr - _buffer;
+    return *this;
+  }
+
+public:
+  LineFormatter();
+  LineFormatter(const LineFormatter &) = delete;
+  LineFormatter &operator=(const LineFormatter &) = delete;
+
+  void clear() { _size = 0; }
+  const char *data() const { return _buffer; }
+  size_t size() const { return _size; }
+  std::string_view view() const { return {_buffer, _size}; }
+
+  // input past the end of the buffer is cut off
+  LineFormatter &append(std::string_view text_);
+  LineFormatter &append(char char_);
+  LineFormatter &appendTime(timestamp_t time_);
+
+  template <typename T> LineFormatter &append(const T &value_) {
+    if constexpr (std::is_enum_v<T>)
+      return append(enum2sv(value_));
+    else if constexpr (std::is_same_v<T, timestamp_t>)
+      return appendTime(value_);
+    else if constexpr (std::is_arithmetic_v<T>)
+      return appendNumber(value_);
+    else
+      return append(std::string_view(value_));
+  }
+
+  // name=value followed by a space, the layout LOG_NVP produces
+  template <typename T>
+  LineFormatter &field(std::string_view name_, const T &value_) {
+    return append(name_).append('=').append(value_).append(' ');
+  }
+};
@@ -0,0 +1,170 @@
+#include "Logger.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "LineFormatter.h"
+#include "Utils.h"
+
+static constexpr std::string_view LevelNames[] = {" INFO    ", " WARN    ",
+                                                  " ERROR   "};
+
+LogLine &LogLine::text(std::string_view text_) {
+  // the tag and a two byte length go first
+  size_t header = 1 + sizeof(uint16_t);
+  if (_size + header > sizeof(_args)) {
+    _truncated = true;
+    return *this;
+  }
+  size_t room = sizeof(_args) - _size - header;
+  if (text_.size() > room) {
+    text_ = text_.substr(0, room);
+    _truncated = true;
+  }
+  auto length = static_cast<uint16_t>(text_.size());
+  _args[_size++] = static_cast<char>(Tag::Text);
+  std::memcpy(_args + _size, &length, sizeof(length));
+  _size += sizeof(length);
+  std::memcpy(_args + _size, text_.data(), length);
+  _size += length;
+  return *this;
+}
+
+void LogLine::format(LineFormatter &out_) const {
+  out_.clear();
+  out_.append(_time).append(LevelNames[static_cast<int>(_level)]);
+  for (size_t pos(0); pos < _size;) {
+    auto tag = static_cast<Tag>(_args[pos++]);
+    switch (tag) {
+    case Tag::Int: {
+      int64_t value;
+      std::memcpy(&value, _args + pos, sizeof(value));
+      out_.append(value);
+      pos += sizeof(value);
+      break;
+    }
+    case Tag::UInt: {
+      uint64_t value;
+      std::memcpy(&value, _args + pos, sizeof(value));
+      out_.append(value);
+      pos += sizeof(value);
+      break;
+    }
+    case Tag::Double: {
+      double value;
+      std::memcpy(&value, _args + pos, sizeof(value));
+      out_.append(value);
+      pos += sizeof(value);
+      break;
+    }
+    case Tag::Char:
+      out_.append(_args[pos++]);
+      break;
+    case Tag::Text: {
+      uint16_t length;
+      std::memcpy(&length, _args + pos, sizeof(length));
+      pos += sizeof(length);
+      out_.append(std::string_view(_args + pos, length));
+      pos += length;
+      break;
+    }
+    }
+  }
+  if (_truncated)
+    out_.append("...");
+  out_.append(" |").append(_file).append(':').append(_line).append('\n');
+}
+
+Logger::Logger()
+    : _running(true), _flushRequests(0), _flushed(0), _droppedTotal(0),
+      _thread(&Logger::main, this) {}
+
+Logger::~Logger() {
+  _running = false;
+  if (_thread.joinable())
+    _thread.join();
+}
+
+Logger &Logger::instance() {
+  static Logger logger;
+  return logger;
+}
+
+thread_local Logger::ThreadHandle Logger::_threadHandle;
+
+Logger::ThreadHandle::~ThreadHandle() {
+  if (buffer)
+    buffer->abandoned.store(true, std::memory_order_release);
+  buffer = nullptr;
+}
+
+Logger::Buffer *Logger::registerThread() {
+  auto buffer = std::make_unique<Buffer>(LinesPerThread);
+  _threadHandle.buffer = buffer.get();
+  std::lock_guard<std::mutex> lock(_buffersMutex);
+  _buffers.push_back(std::move(buffer));
+  return _threadHandle.buffer;
+}
+
+void Logger::push(const LogLine &line_) {
+  Buffer *buffer = _threadHandle.buffer;
+  if (not buffer)
+    buffer = registerThread();
+  if (not buffer->ring.tryPush(line_))
+    buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Logger::flush() {
+  uint64_t request = ++_flushRequests;
+  while (_flushed.load(std::memory_order_acquire) < request)
+    std::this_thread::yield();
+}
+
+size_t Logger::drain() {
+  LineFormatter line;
+  LogLine batch[16];
+  size_t total(0);
+  std::lock_guard<std::mutex> lock(_buffersMutex);
+  for (auto it = _buffers.begin(); it != _buffers.end();) {
+    Buffer &buffer = **it;
+    // read before draining so nothing pushed before the exit is missed
+    bool abandoned = buffer.abandoned.load(std::memory_order_acquire);
+    size_t count;
+    while ((count = buffer.ring.popBatch(batch, std::size(batch))) > 0) {
+      for (size_t i(0); i < count; i++) {
+        batch[i].format(line);
+        std::fwrite(line.data(), 1, line.size(), stdout);
+      }
+      total += count;
+    }
+    size_t dropped = buffer.dropped.load(std::memory_order_relaxed);
+    if (dropped != buffer.reported) {
+      LogLine note(LogLevel::Warn, __FILENAME__, __LINE__);
+      note << "Log lines dropped, ring full "
+           << LOG_NVP("Count", dropped - buffer.reported);
+      note.format(line);
+      std::fwrite(line.data(), 1, line.size(), stdout);
+      _droppedTotal += dropped - buffer.reported;
+      buffer.reported = dropped;
+    }
+    if (abandoned)
+      it = _buffers.erase(it);
+    else
+      ++it;
+  }
+  if (total)
+    std::fflush(stdout);
+  return total;
+}
+
+void Logger::main() {
+  while (_running) {
+    uint64_t requests = _flushRequests.load(std::memory_order_acquire);
+    size_t count = drain();
+    _flushed.store(requests, std::memory_order_release);
+    if (count == 0)
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+  }
+  drain();
+  _flushed.store(_flushRequests.load());
+}
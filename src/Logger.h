@@ -0,0 +1,156 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "SpscRing.h"
+
+// Calls below ORDERBOOK_LOG_LEVEL compile to nothing, their arguments are
+// never evaluated. Set from the LOG_LEVEL cmake option.
+#define ORDERBOOK_LOG_INFO 0
+#define ORDERBOOK_LOG_WARN 1
+#define ORDERBOOK_LOG_ERROR 2
+#define ORDERBOOK_LOG_NONE 3
+#ifndef ORDERBOOK_LOG_LEVEL
+#define ORDERBOOK_LOG_LEVEL ORDERBOOK_LOG_INFO
+#endif
+
+#define __FILENAME__                                                           \
+  (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1     \
+                                    : __FILE__)
+#define LOG_AT(level_, msg_)                                                   \
+  Logger::instance().push(LogLine(level_, __FILENAME__, __LINE__) << msg_)
+
+#if ORDERBOOK_LOG_LEVEL <= ORDERBOOK_LOG_INFO
+#define INFO(msg_) LOG_AT(LogLevel::Info, msg_)
+#else
+#define INFO(msg_) ((void)0)
+#endif
+#if ORDERBOOK_LOG_LEVEL <= ORDERBOOK_LOG_WARN
+#define WARN(msg_) LOG_AT(LogLevel::Warn, msg_)
+#else
+#define WARN(msg_) ((void)0)
+#endif
+#if ORDERBOOK_LOG_LEVEL <= ORDERBOOK_LOG_ERROR
+#define ERROR(msg_) LOG_AT(LogLevel::Error, msg_)
+#else
+#define ERROR(msg_) ((void)0)
+#endif
+
+enum class LogLevel : uint8_t { Info, Warn, Error };
+
+class LineFormatter;
+
+// One log call with its arguments copied in raw, tagged form. Nothing is
+// formatted until the logger thread picks the line up. Arguments that do not
+// fit are cut off and the line is marked truncated.
+class LogLine {
+public:
+  enum class Tag : uint8_t { Int, UInt, Double, Char, Text };
+  static constexpr size_t Size = 256;
+
+private:
+  std::chrono::system_clock::time_point _time;
+  const char *_file;
+  int _line;
+  LogLevel _level;
+  bool _truncated;
+  uint16_t _size;
+  char _args[Size - 24];
+
+  template <typename T> LogLine &put(Tag tag_, T value_) {
+    if (_size + 1 + sizeof(T) > sizeof(_args)) {
+      _truncated = true;
+      return *this;
+    }
+    _args[_size++] = static_cast<char>(tag_);
+    std::memcpy(_args + _size, &value_, sizeof(T));
+    _size += sizeof(T);
+    return *this;
+  }
+
+public:
+  LogLine() : _time(), _file(""), _line(0), _level(), _truncated(), _size(0) {}
+  LogLine(LogLevel level_, const char *file_, int line_)
+      : _time(std::chrono::system_clock::now()), _file(file_), _line(line_),
+        _level(level_), _truncated(false), _size(0) {}
+
+  LogLine &text(std::string_view text_);
+
+  template <typename T> LogLine &operator<<(const T &value_) {
+    if constexpr (std::is_enum_v<T>)
+      return text(enum2sv(value_));
+    else if constexpr (std::is_same_v<T, char>)
+      return put(Tag::Char, value_);
+    else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+      return put(Tag::Int, static_cast<int64_t>(value_));
+    else if constexpr (std::is_integral_v<T>)
+      return put(Tag::UInt, static_cast<uint64_t>(value_));
+    else if constexpr (std::is_floating_point_v<T>)
+      return put(Tag::Double, static_cast<double>(value_));
+    else
+      return text(std::string_view(value_));
+  }
+
+  LogLevel level() const { return _level; }
+  // renders the whole line, newline included
+  void format(LineFormatter &out_) const;
+};
+
+static_assert(sizeof(LogLine) == LogLine::Size, "log line layout changed");
+
+// Writes log lines to stdout from a background thread. Each logging thread
+// gets its own ring on first use, so a log call is one copy into memory no
+// other thread writes. A full ring drops the line rather than wait.
+class Logger {
+  struct Buffer {
+    explicit Buffer(size_t capacity_)
+        : ring(capacity_), dropped(0), reported(0), abandoned(false) {}
+    SpscRing<LogLine> ring;
+    std::atomic<size_t> dropped;
+    size_t reported;
+    // set when the owning thread exits, the logger frees it once drained
+    std::atomic<bool> abandoned;
+  };
+
+  // marks the thread's buffer abandoned when the thread exits
+  struct ThreadHandle {
+    Buffer *buffer = nullptr;
+    ~ThreadHandle();
+  };
+
+  static constexpr size_t LinesPerThread = 1024;
+  static thread_local ThreadHandle _threadHandle;
+
+  std::mutex _buffersMutex;
+  std::vector<std::unique_ptr<Buffer>> _buffers;
+  std::atomic<bool> _running;
+  std::atomic<uint64_t> _flushRequests;
+  std::atomic<uint64_t> _flushed;
+  std::atomic<size_t> _droppedTotal;
+  std::thread _thread;
+
+  Logger();
+  Buffer *registerThread();
+  size_t drain();
+  void main();
+
+public:
+  ~Logger();
+  Logger(const Logger &) = delete;
+  Logger &operator=(const Logger &) = delete;
+
+  static Logger &instance();
+
+  void push(const LogLine &line_);
+  // returns once every line logged before the call has been written
+  void flush();
+  size_t dropped() const { return _droppedTotal; }
+};
@@ -0,0 +1,194 @@
+#include "MatchingEngine.h"
+
+#include <algorithm>
+#include <cstring>
+#include <pthread.h>
+
+MatchingEngine::Shard::Shard(size_t index_, const EngineConfig &config_)
+    : index(index_), execReports(config_.maxExecReports), books(),
+      commands(config_.maxPendingCommands), workSignal(config_.waitStrategy),
+      clock(), thread() {}
+
+MatchingEngine::MatchingEngine(const std::vector<Listing> &listings_,
+                               const EngineConfig &config_)
+    : _config(config_), _shards(), _routes(), _books(), _running(false) {
+  for (size_t i(0); i < std::max<size_t>(config_.shards, 1); i++)
+    _shards.push_back(std::make_unique<Shard>(i, config_));
+  _routes.reserve(listings_.size());
+  for (auto &listing : listings_) {
+    if (_routes.count(listing.symbol)) {
+      WARN("Duplicate listing ignored " << LOG_NVP("Symbol", listing.symbol));
+      continue;
+    }
+    Shard &shard = *_shards[_books.size() % _shards.size()];
+    BookConfig bookConfig = config_.book;
+    // the shard thread is the books' single writer
+    bookConfig.matchingMode = MatchingMode::Inline;
+    bookConfig.bookID = static_cast<uint32_t>(_books.size());
+    bookConfig.clock = &shard.clock;
+    shard.books.push_back(std::make_unique<OrderBook>(
+        listing.symbol, listing.closePrice, bookConfig, &shard.execReports));
+    _books.push_back(shard.books.back().get());
+    auto index = static_cast<uint32_t>(shard.books.size() - 1);
+    _routes.emplace(listing.symbol, Route{&shard, index});
+  }
+}
+
+MatchingEngine::~MatchingEngine() { stop(); }
+
+void MatchingEngine::pinToCore(std::thread &thread_, int core_) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(core_, &cpus);
+  int error =
+      pthread_setaffinity_np(thread_.native_handle(), sizeof(cpus), &cpus);
+  if (error != 0)
+    WARN("Failed to pin shard thread " << LOG_NVP("Core", core_)
+                                       << LOG_NVP("Error",
+                                                  std::strerror(error)));
+}
+
+void MatchingEngine::start() {
+  INFO("Matching engine start " << LOG_NVP("Shards", _shards.size())
+                                << LOG_NVP("Books", _books.size()));
+  _running = true;
+  for (auto &shard : _shards) {
+    for (auto &book : shard->books)
+      book->start();
+    shard->thread = std::thread(&MatchingEngine::shardRoutine, this,
+                                std::ref(*shard));
+    if (shard->index < _config.cores.size())
+      pinToCore(shard->thread, _config.cores[shard->index]);
+  }
+}
+
+void MatchingEngine::stop() {
+  if (not _running.exchange(false))
+    return;
+  for (auto &shard : _shards) {
+    shard->workSignal.notify();
+    if (shard->thread.joinable())
+      shard->thread.join();
+    for (auto &book : shard->books)
+      book->stop();
+  }
+  INFO("Matching engine finish");
+}
+
+void MatchingEngine::shardRoutine(Shard &shard_) {
+  while (_running) {
+    auto ticket = shard_.workSignal.ticket();
+    shard_.clock.update();
+    if (not processCommands(shard_))
+      shard_.workSignal.wait(ticket);
+  }
+  processCommands(shard_);
+}
+
+bool MatchingEngine::processCommands(Shard &shard_) {
+  auto processed = shard_.commands.drain([&shard_](Command &command_) {
+    shard_.books[command_.book]->onQueuedCommand(command_.request);
+  });
+  return processed > 0;
+}
+
+const MatchingEngine::Route *
+MatchingEngine::findRoute(const std::string &symbol_) const {
+  auto it = _routes.find(symbol_);
+  return it == _routes.end() ? nullptr : &it->second;
+}
+
+bool MatchingEngine::submit(CommandType type_, const std::string &symbol_,
+                            const Order &order_) {
+  const Route *route = findRoute(symbol_);
+  if (!route) {
+    WARN("Unknown symbol " << LOG_NVP("Symbol", symbol_)
+                           << LOG_NVP("Type", type_));
+    return false;
+  }
+  return submit(*route, type_, order_);
+}
+
+bool MatchingEngine::submit(const Route &route_, CommandType type_,
+                            const Order &order_) {
+  Shard &shard = *route_.shard;
+  Command command{route_.book, {type_, order_}};
+  // time spent in the shard queue counts toward order to ack
+  if (type_ == CommandType::NewOrder)
+    command.request.order.setEntryTimeNow();
+  if (not shard.commands.tryPush(command)) {
+    WARN("Shard queue full " << LOG_NVP("Shard", shard.index)
+                             << LOG_NVP("Type", type_));
+    return false;
+  }
+  shard.workSignal.notify();
+  return true;
+}
+
+bool MatchingEngine::onOrderSingle(const Order &order_) {
+  return submit(CommandType::NewOrder, order_.symbol(), order_);
+}
+
+bool MatchingEngine::onOrderCancelRequest(const Order &order_) {
+  return submit(CommandType::CancelOrder, order_.symbol(), order_);
+}
+
+bool MatchingEngine::onNewOrder(const NewOrderView &message_) {
+  if (message_.side() == Side::Unknown) {
+    WARN("Unknown side on new order "
+         << LOG_NVP("TraderID", message_.traderID()));
+    return false;
+  }
+  std::string symbol(message_.symbol());
+  const Route *route = findRoute(symbol);
+  if (!route) {
+    WARN("Unknown symbol " << LOG_NVP("Symbol", symbol)
+                           << LOG_NVP("Type", CommandType::NewOrder));
+    return false;
+  }
+  // a price built from whole ticks turns back into exactly those ticks
+  ticks_t ticksPerUnit = route->shard->books[route->book]->ticksPerUnit();
+  auto ticks = message_.ticks(ticksPerUnit);
+  if (not ticks) {
+    WARN("New order price is not on a tick "
+         << LOG_NVP("TraderID", message_.traderID())
+         << LOG_NVP("Symbol", symbol)
+         << LOG_NVP("PriceMantissa", message_.priceMantissa()));
+    return false;
+  }
+  Order order(message_.side(), message_.qty(),
+              static_cast<price_t>(*ticks) / ticksPerUnit);
+  order.settraderID(message_.traderID());
+  return submit(*route, CommandType::NewOrder, order);
+}
+
+bool MatchingEngine::onCancelReplace(const CancelReplaceView &message_) {
+  Order request(Side::Unknown, message_.qty(), 0);
+  request.setorderID(message_.orderID());
+  request.settraderID(message_.traderID());
+  return submit(CommandType::CancelOrder, std::string(message_.symbol()),
+                request);
+}
+
+bool MatchingEngine::onCancel(const CancelView &message_) {
+  Order request(Side::Unknown, 0, 0);
+  request.setorderID(message_.orderID());
+  request.settraderID(message_.traderID());
+  return submit(CommandType::CancelOrder, std::string(message_.symbol()),
+                request);
+}
+
+size_t MatchingEngine::shardOf(const std::string &symbol_) const {
+  const Route *route = findRoute(symbol_);
+  return route ? route->shard->index : npos;
+}
+
+size_t MatchingEngine::getExecMessages(size_t shard_, ExecReport *out_,
+                                       size_t max_) {
+  return _shards[shard_]->execReports.popBatch(out_, max_);
+}
+
+const OrderBook *MatchingEngine::book(const std::string &symbol_) const {
+  const Route *route = findRoute(symbol_);
+  return route ? route->shard->books[route->book].get() : nullptr;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Domain.h"
+#include "MpscQueue.h"
+#include "OrderBook.h"
+#include "OrderEntry.h"
+#include "SpscRing.h"
+#include "WorkSignal.h"
+
+struct Listing {
+  std::string symbol;
+  price_t closePrice;
+};
+
+struct EngineConfig {
+  size_t shards = 1;
+  // core each shard's thread is pinned to, by shard. Shards past the end of
+  // the list are left to the scheduler.
+  std::vector<int> cores;
+  // applied to every book, bookID, matchingMode and clock are set by the
+  // engine
+  BookConfig book;
+  // per shard, shared by all of the shard's books
+  size_t maxExecReports = 65536;
+  size_t maxPendingCommands = 65536;
+  WaitStrategy waitStrategy = WaitStrategy::Block;
+};
+
+// Hosts many books split across shards. Each shard owns its books outright
+// and runs them Inline on its own thread, fed through its own command queue
+// and publishing to its own exec report stream. The routing table is built
+// once up front and only read afterwards, so client threads route requests
+// without taking any lock and shards never touch each other's state.
+class MatchingEngine {
+  struct Command {
+    uint32_t book = 0;
+    // new orders are stamped with their entry time as they are queued
+    OrderBook::Command request;
+  };
+
+  struct Shard {
+    Shard(size_t index_, const EngineConfig &config_);
+    size_t index;
+    SpscRing<ExecReport> execReports;
+    std::vector<std::unique_ptr<OrderBook>> books;
+    MpscQueue<Command> commands;
+    WorkSignal workSignal;
+    // shared by the shard's books, updated once per loop
+    CoarseClock clock;
+    std::thread thread;
+  };
+
+  struct Route {
+    Shard *shard;
+    // index into the shard's books
+    uint32_t book;
+  };
+
+  EngineConfig _config;
+  std::vector<std::unique_ptr<Shard>> _shards;
+  std::unordered_map<std::string, Route> _routes;
+  // by bookID
+  std::vector<const OrderBook *> _books;
+  std::atomic<bool> _running;
+
+  const Route *findRoute(const std::string &symbol_) const;
+  bool submit(CommandType type_, const std::string &symbol_,
+              const Order &order_);
+  bool submit(const Route &route_, CommandType type_, const Order &order_);
+  void shardRoutine(Shard &shard_);
+  static bool processCommands(Shard &shard_);
+  static void pinToCore(std::thread &thread_, int core_);
+
+public:
+  // books are spread over the shards in listing order, round robin
+  explicit MatchingEngine(const std::vector<Listing> &listings_,
+                          const EngineConfig &config_ = EngineConfig());
+  ~MatchingEngine();
+  MatchingEngine(const MatchingEngine &) = delete;
+  MatchingEngine &operator=(const MatchingEngine &) = delete;
+
+  void start();
+  // drains every queued request before returning
+  void stop();
+
+  // safe from any thread, routed by the order's symbol. Returns false for an
+  // unknown symbol or a full shard queue.
+  bool onOrderSingle(const Order &order_);
+  bool onOrderCancelRequest(const Order &order_);
+  // Binary order entry, straight from the decoder's views. Symbols of up to
+  // eight characters fit std::string's small buffer, so routing a message
+  // does not allocate.
+  bool onNewOrder(const NewOrderView &message_);
+  bool onCancelReplace(const CancelReplaceView &message_);
+  bool onCancel(const CancelView &message_);
+
+  size_t shardCount() const { return _shards.size(); }
+  // npos for an unknown symbol
+  size_t shardOf(const std::string &symbol_) const;
+  static constexpr size_t npos = size_t(-1);
+
+  // one reader thread per shard
+  size_t getExecMessages(size_t shard_, ExecReport *out_, size_t max_);
+  // the book an exec report came from
+  const std::string &symbolOf(uint32_t bookID_) const {
+    return _books[bookID_]->symbol();
+  }
+  // for inspection once the engine is stopped
+  const OrderBook *book(const std::string &symbol_) const;
+};
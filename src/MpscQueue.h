@@ -0,0 +1,130 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Bounded lock free queue for any number of producer threads and a single
+// consumer. Each slot carries a sequence number telling producers whether it
+// is free to claim and the consumer whether it has been published, so
+// producers only contend on the tail index and never on each other's slots.
+template <typename T> class MpscQueue {
+  static constexpr size_t CacheLine = 64;
+
+  struct Slot {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  alignas(CacheLine) std::atomic<size_t> _tail;
+  alignas(CacheLine) size_t _head;
+  size_t _capacity;
+  size_t _mask;
+  std::unique_ptr<Slot[]> _slots;
+
+  static size_t roundUp(size_t capacity_) {
+    size_t size(1);
+    while (size < capacity_)
+      size <<= 1;
+    return size;
+  }
+
+public:
+  // capacity is rounded up to a power of two
+  explicit MpscQueue(size_t capacity_)
+      : _tail(0), _head(0), _capacity(roundUp(capacity_)),
+        _mask(_capacity - 1), _slots(new Slot[_capacity]) {
+    for (size_t i(0); i < _capacity; i++)
+      _slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  // producer side, safe from any thread. Returns false when full.
+  bool tryPush(const T &value_) {
+    size_t pos = _tail.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+      slot = &_slots[pos & _mask];
+      size_t sequence = slot->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (_tail.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = _tail.load(std::memory_order_relaxed);
+      }
+    }
+    slot->value = value_;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // producer side, safe from any thread. Claims room for as many of the
+  // first values_ as fit with one update of the tail, so a batch is queued
+  // contiguously. Returns how many were pushed.
+  size_t tryPushBatch(const T *values_, size_t count_) {
+    size_t pos = _tail.load(std::memory_order_relaxed);
+    size_t count;
+    if (count_ == 0)
+      return 0;
+    for (;;) {
+      auto diff = static_cast<intptr_t>(
+                      _slots[pos & _mask].sequence.load(
+                          std::memory_order_acquire)) -
+                  static_cast<intptr_t>(pos);
+      if (diff < 0)
+        return 0;
+      if (diff > 0) {
+        pos = _tail.load(std::memory_order_relaxed);
+        continue;
+      }
+      // slots are freed in order, so if the last slot of a run is free the
+      // whole run is
+      auto isFree = [this, &pos](size_t run_) {
+        Slot &slot = _slots[(pos + run_ - 1) & _mask];
+        return slot.sequence.load(std::memory_order_acquire) ==
+               pos + run_ - 1;
+      };
+      size_t low(1), high(std::min(count_, _capacity));
+      while (low < high) {
+        size_t mid = (low + high + 1) / 2;
+        if (isFree(mid))
+          low = mid;
+        else
+          high = mid - 1;
+      }
+      count = low;
+      if (_tail.compare_exchange_weak(pos, pos + count,
+                                      std::memory_order_relaxed))
+        break;
+    }
+    for (size_t i(0); i < count; i++) {
+      Slot &slot = _slots[(pos + i) & _mask];
+      slot.value = values_[i];
+      slot.sequence.store(pos + i + 1, std::memory_order_release);
+    }
+    return count;
+  }
+
+  // consumer side. Hands each published element to fn_ in place, stopping
+  // at the first slot a producer has claimed but not yet published.
+  template <typename Fn> size_t drain(Fn &&fn_, size_t max_ = SIZE_MAX) {
+    size_t count(0);
+    while (count < max_) {
+      Slot &slot = _slots[_head & _mask];
+      if (slot.sequence.load(std::memory_order_acquire) != _head + 1)
+        break;
+      fn_(slot.value);
+      slot.sequence.store(_head + _capacity, std::memory_order_release);
+      ++_head;
+      ++count;
+    }
+    return count;
+  }
+
+  size_t capacity() const { return _capacity; }
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+// Fixed capacity free list of equal sized blocks, allocated once up front,
+// for node based containers that must not touch the heap once running.
+// Anything larger than a block, or past capacity, is served by the heap and
+// counted, so a pool sized from a known bound can be checked to hold it. Not
+// thread safe, the owner is expected to be the only thread allocating.
+class NodePool {
+  size_t _blockSize;
+  size_t _capacity;
+  std::unique_ptr<unsigned char[]> _storage;
+  void *_free;
+  size_t _size;
+  size_t _heapAllocations;
+
+  bool owns(const void *block_) const {
+    auto *bytes = static_cast<const unsigned char *>(block_);
+    return bytes >= _storage.get() &&
+           bytes < _storage.get() + _blockSize * _capacity;
+  }
+
+public:
+  NodePool(size_t blockSize_, size_t capacity_)
+      : _blockSize((std::max(blockSize_, sizeof(void *)) +
+                    alignof(std::max_align_t) - 1) /
+                   alignof(std::max_align_t) * alignof(std::max_align_t)),
+        _capacity(capacity_),
+        _storage(new unsigned char[_blockSize * capacity_]), _free(nullptr),
+        _size(0), _heapAllocations(0) {
+    // threaded back to front so blocks are handed out in order
+    for (size_t i(capacity_); i-- > 0;) {
+      void *block = _storage.get() + i * _blockSize;
+      *static_cast<void **>(block) = _free;
+      _free = block;
+    }
+  }
+  NodePool(const NodePool &) = delete;
+  NodePool &operator=(const NodePool &) = delete;
+
+  void *allocate(size_t size_) {
+    if (size_ > _blockSize || !_free) {
+      ++_heapAllocations;
+      return ::operator new(size_);
+    }
+    void *block = _free;
+    _free = *static_cast<void **>(block);
+    ++_size;
+    return block;
+  }
+
+  void deallocate(void *block_) {
+    if (not owns(block_)) {
+      ::operator delete(block_);
+      return;
+    }
+    *static_cast<void **>(block_) = _free;
+    _free = block_;
+    --_size;
+  }
+
+  size_t blockSize() const { return _blockSize; }
+  size_t capacity() const { return _capacity; }
+  // blocks currently handed out
+  size_t size() const { return _size; }
+  // requests the pool could not serve
+  size_t heapAllocations() const { return _heapAllocations; }
+};
+
+// Hands a node based container its nodes one at a time from a NodePool.
+// Copies, and rebinds to the container's node type, share the pool.
+template <typename T> class PoolAllocator {
+  NodePool *_pool;
+
+  template <typename U> friend class PoolAllocator;
+
+public:
+  using value_type = T;
+
+  explicit PoolAllocator(NodePool *pool_) : _pool(pool_) {}
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U> &other_) : _pool(other_._pool) {}
+
+  T *allocate(size_t count_) {
+    if (count_ != 1)
+      return static_cast<T *>(::operator new(count_ * sizeof(T)));
+    return static_cast<T *>(_pool->allocate(sizeof(T)));
+  }
+  void deallocate(T *object_, size_t count_) {
+    if (count_ != 1)
+      ::operator delete(object_);
+    else
+      _pool->deallocate(object_);
+  }
+
+  template <typename U> bool operator==(const PoolAllocator<U> &other_) const {
+    return _pool == other_._pool;
+  }
+  template <typename U> bool operator!=(const PoolAllocator<U> &other_) const {
+    return _pool != other_._pool;
+  }
+};
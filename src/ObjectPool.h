@@ -0,0 +1,61 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+// Fixed capacity pool of T, allocated once up front. Objects are constructed
+// in place on acquire() and handed out as raw pointers; acquire() returns
+// nullptr once every slot is in use. Not thread safe, the owner is expected
+// to be the only thread acquiring and releasing.
+template <typename T> class ObjectPool {
+  union Slot {
+    Slot *next;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  std::unique_ptr<Slot[]> _slots;
+  Slot *_free;
+  size_t _capacity;
+  size_t _size;
+  size_t _highWater;
+
+public:
+  explicit ObjectPool(size_t capacity_)
+      : _slots(new Slot[capacity_]), _free(nullptr), _capacity(capacity_),
+        _size(0), _highWater(0) {
+    // thread the free list back to front so slots are handed out in order
+    for (size_t i(capacity_); i-- > 0;) {
+      _slots[i].next = _free;
+      _free = &_slots[i];
+    }
+  }
+  ObjectPool(const ObjectPool &) = delete;
+  ObjectPool &operator=(const ObjectPool &) = delete;
+
+  template <typename... Args> T *acquire(Args &&...args_) {
+    if (!_free)
+      return nullptr;
+    Slot *slot = _free;
+    _free = slot->next;
+    T *object = new (slot->storage) T(std::forward<Args>(args_)...);
+    _highWater = std::max(_highWater, ++_size);
+    return object;
+  }
+
+  void release(T *object_) {
+    object_->~T();
+    Slot *slot = reinterpret_cast<Slot *>(object_);
+    slot->next = _free;
+    _free = slot;
+    --_size;
+  }
+
+  size_t capacity() const { return _capacity; }
+  // number of objects currently handed out
+  size_t size() const { return _size; }
+  // most objects ever handed out at once
+  size_t highWater() const { return _highWater; }
+  bool full() const { return _free == nullptr; }
+};
@@ -1,297 +1,933 @@
 #include <algorithm>
+#include <cstring>
+#include <limits>
 #include <memory>
-#include <queue>
 #include <thread>
+#include <utility>
 
 #include "OrderBook.h"
+#include "Snapshot.h"
 
-OrderBook::OrderBook(std::string symbol_, price_t closePrice_)
-    : _buyOrders(), _sellOrders(), _registeredTraders(), _tickSize(0.01),
-      _oidSeed(0), _symbol(std::move(symbol_)), _closePrice(closePrice_),
-      _buyLevels(std::round(1 / _tickSize) * 20, 0),
-      _sellLevels(std::round(1 / _tickSize) * 20, 0), _open(false),
-      _tradedVolume(0) {}
-
-OrderBook::~OrderBook() {
-  _open = false;
-  // wait for matching to stop
-  _matchingThread.join();
+OrderBook::OrderBook(std::string symbol_, price_t closePrice_,
+                     const BookConfig &config_,
+                     SpscRing<ExecReport> *sharedExecReports_)
+    : _orderPool(config_.maxOrders), _rootOrders(config_.maxOrders),
+      _traders(config_.maxTraders), _ownClock(),
+      _clock(config_.clock ? config_.clock : &_ownClock),
+      _tickSize(0.01), _ownExecReports(), _execReports(sharedExecReports_),
+      _config(config_), _oidSeed(0), _execIDSeed(0),
+      _symbol(std::move(symbol_)), _closePrice(closePrice_),
+      // tick size must divide a whole unit of price so that ticks convert
+      // back to the exact decimal price
+      _ticksPerUnit(std::lround(1 / _tickSize)),
+      _closeTicks(toTicks(closePrice_)),
+      _bandTicks(std::llround(config_.priceBand * _ticksPerUnit)),
+      // until the book trades, both touches are expected near the close
+      _farLevelNodes(BookSide::FarNodeSize, config_.maxOrders),
+      _buyLevels(Side::Buy, config_.ladderWindow, _closeTicks,
+                 _farLevelNodes),
+      _sellLevels(Side::Sell, config_.ladderWindow, _closeTicks,
+                  _farLevelNodes),
+      _open(false), _engineThread(), _commands(config_.maxPendingCommands),
+      _workSignal(config_.waitStrategy), _depthFeed(),
+      _orderFeed(), _orderToAck(), _orderToFirstFill(), _tradedVolume(0),
+      _droppedExecReports(0), _snapshotRequest(nullptr), _snapshotsTaken(0),
+      _replayAggressor(nullptr), _staged(new ExecReport[StagedReports]),
+      _stagedCount(0), _staging(false), _phase(TradingPhase::Continuous),
+      _auctionLow(), _auctionHigh(), _auctionDemand(), _auctionSupply(),
+      _auctionVolume() {
+  if (not _execReports) {
+    _ownExecReports =
+        std::make_unique<SpscRing<ExecReport>>(config_.maxExecReports);
+    _execReports = _ownExecReports.get();
+  }
+  if (config_.depthFeedMode != DepthFeedMode::Off)
+    _depthFeed = std::make_unique<DepthFeed>(
+        config_.depthFeedMode, _buyLevels.windowSize(), _ticksPerUnit,
+        config_.depthFeedCapacity);
+  if (config_.orderFeedCapacity)
+    _orderFeed = std::make_unique<OrderFeed>(config_.orderFeedCapacity);
 }
 
+OrderBook::~OrderBook() { stop(); }
+
 void OrderBook::start() {
+  INFO("Continuous trading start " << LOG_NVP("Mode", _config.matchingMode));
   _open = true;
-  _matchingThread = std::thread(&OrderBook::matchingRoutine, this);
+  if (_config.matchingMode == MatchingMode::Async)
+    _engineThread = std::thread(&OrderBook::engineRoutine, this);
 }
 
-void OrderBook::stop() { _open = false; }
+void OrderBook::stop() {
+  if (not _open.exchange(false))
+    return;
+  _workSignal.notify();
+  // wait for the engine to drain what was already queued
+  if (_engineThread.joinable())
+    _engineThread.join();
+  INFO("Continuous trading finish " << LOG_NVP("TotalVolume", _tradedVolume));
+}
 
-void OrderBook::matchingRoutine() {
-  INFO("Continuous trading start");
+void OrderBook::engineRoutine() {
   while (_open) {
-    match();
+    auto ticket = _workSignal.ticket();
+    updateOwnClock();
+    serviceSnapshot();
+    if (not processCommands())
+      _workSignal.wait(ticket);
   }
-  INFO("Continuous trading finish " << LOG_NVP("TotalVolume", _tradedVolume));
+  processCommands();
 }
 
-bool OrderBook::isTickAligned(price_t price_) const {
-  if (((int)std::round(price_ * 100) % (int)std::round(tickSize() * 100)) != 0)
+bool OrderBook::submitCommand(CommandType type_, const Order &order_) {
+  if (not _commands.tryPush(Command{type_, order_})) {
+    WARN("Command queue full " << LOG_NVP("Capacity", _commands.capacity())
+                               << LOG_NVP("Type", type_));
     return false;
+  }
+  _workSignal.notify();
   return true;
 }
 
-bool OrderBook::isValidPrice(price_t price_) const {
-  if (std::abs(_closePrice - price_) > 10)
+void OrderBook::processCommand(Command &command_) {
+  switch (command_.type) {
+  case CommandType::NewOrder:
+    processNewOrder(command_.order);
+    break;
+  case CommandType::CancelOrder:
+    processCancelRequest(command_.order);
+    break;
+  case CommandType::StartAuction:
+    INFO("Auction start " << LOG_NVP("Symbol", _symbol));
+    _phase = TradingPhase::Auction;
+    addExecReport(Order(), ExecType::Phase, ExecText::AuctionStarted);
+    break;
+  case CommandType::Uncross:
+    processUncross();
+    break;
+  default:
+    break;
+  }
+}
+
+bool OrderBook::processCommands() {
+  // whatever has queued up since the last pass goes out as one batch
+  beginStaging();
+  auto processed = _commands.drain(
+      [this](Command &command_) { processCommand(command_); });
+  endStaging();
+  return processed > 0;
+}
+
+ticks_t OrderBook::toTicks(price_t price_) const {
+  return std::llround(price_ * _ticksPerUnit);
+}
+
+price_t OrderBook::toPrice(ticks_t ticks_) const {
+  return static_cast<price_t>(ticks_) / _ticksPerUnit;
+}
+
+bool OrderBook::isTickAligned(price_t price_) const {
+  return almost_equal(price_ * _ticksPerUnit,
+                      static_cast<price_t>(toTicks(price_)));
+}
+
+bool OrderBook::isValidPrice(ticks_t ticks_) const {
+  if (ticks_ < 0)
     return false;
-  return true;
+  return _bandTicks == 0 || std::abs(_closeTicks - ticks_) <= _bandTicks;
 }
 
-void OrderBook::updateLevel(Side side_, price_t price_, qty_t qty_) {
-  auto &levels = side_ == Side::Buy ? _buyLevels : _sellLevels;
-  // close and price must always be tick aligned, and price within 10 of
-  // closePrice
-  price_t normaliser = std::max(_closePrice - 10, 0.0);
-  size_t level = (price_ - normaliser) / _tickSize;
-  levels[level] += qty_;
+// called once the level's orders are in their new state, so the published
+// order count is current
+void OrderBook::updateLevel(Side side_, ticks_t ticks_, qty_t qty_) {
+  BookSide &side = getBookSide(side_);
+  // a level outside the window is dropped with its last order
+  PriceLevel *level = side.level(ticks_);
+  if (level)
+    level->addQty(qty_);
+  if (_depthFeed)
+    _depthFeed->publish(side_, ticks_, level ? level->qty() : 0,
+                        level ? level->count() : 0, side.bestTicks(),
+                        side.inWindow(ticks_));
+}
+
+void OrderBook::recenterLadders() {
+  for (BookSide *side : {&_buyLevels, &_sellLevels}) {
+    if (not side->offCenter())
+      continue;
+    // the depth feed only mirrors the window, so it hears of every level
+    // moving in or out of it
+    side->recenter(
+        [this, side](ticks_t ticks_, const PriceLevel &level_, bool inWindow_) {
+          if (_depthFeed)
+            _depthFeed->publish(side->side(), ticks_, level_.qty(),
+                                level_.count(), side->bestTicks(), inWindow_);
+        });
+  }
 }
 
 qty_t OrderBook::qtyAtLevel(Side side_, price_t price_) const {
-  auto &levels = side_ == Side::Buy ? _buyLevels : _sellLevels;
-  if (price_ < 0 || price_ > levels.size())
-    return 0;
-  price_t normaliser = std::max(_closePrice - 10, 0.0);
-  int index = (price_ - normaliser) / _tickSize;
-  return levels[index];
+  const PriceLevel *level = getBookSide(side_).level(toTicks(price_));
+  return level ? level->qty() : 0;
 }
 
-Trader::Ptr OrderBook::registerTrader(int traderID_) {
-  auto trader = std::make_shared<Trader>();
-  _registeredTraders.emplace(std::pair(traderID_, trader));
-  return trader;
+void OrderBook::registerTrader(int traderID_) {
+  Trader *trader = findTrader(traderID_);
+  if (trader && not trader->isRegistered())
+    trader->registerAt(_clock->nanos(), _config.rateLimit);
 }
 
-bool OrderBook::isTraderRegistered(int traderID_) {
-  if (_registeredTraders.find(traderID_) == _registeredTraders.end())
-    return false;
-  return true;
+BookSide &OrderBook::getBookSide(Side side_) {
+  return (side_ == Side::Buy) ? _buyLevels : _sellLevels;
+}
+
+const BookSide &OrderBook::getBookSide(Side side_) const {
+  return (side_ == Side::Buy) ? _buyLevels : _sellLevels;
 }
 
-OrderBook::OrderQueue &OrderBook::getOrderQueue(Side side_) {
-  return (side_ == Side::Buy) ? _buyOrders : _sellOrders;
+bool OrderBook::onOrderSingle(Order &order_) {
+  if (_config.matchingMode == MatchingMode::Async) {
+    order_.setEntryTimeNow();
+    return submitCommand(CommandType::NewOrder, order_);
+  }
+  updateOwnClock();
+  serviceSnapshot();
+  order_.setEntryTimeNow();
+  processNewOrder(order_);
+  return true;
 }
 
-void OrderBook::onOrderSingle(Order::Ptr &order_) {
-  order_->setEntryTimeNow();
-  order_->setorderID(++_oidSeed);
-  std::lock_guard<decltype(_mutex)> lock(_mutex);
-  auto &orderQueue = getOrderQueue(order_->side());
-  if (not isTickAligned(order_->price())) {
-    INFO("Order price is not a multiple of ticksize" << LOG_VAR(order_->price())
+void OrderBook::processNewOrder(Order &order_) {
+  // IDs are handed out in the order the writer processes requests
+  order_.setorderID(++_oidSeed);
+  if (order_.ordQty() <= 0) {
+    INFO("Order quantity is not positive" << LOG_VAR(order_.ordQty()));
+    rejectNewOrderRequest(order_, ExecText::QtyNotPositive);
+    return;
+  }
+  if (not isTickAligned(order_.price())) {
+    INFO("Order price is not a multiple of ticksize" << LOG_VAR(order_.price())
                                                      << LOG_VAR(_tickSize));
-    rejectNewOrderRequest(order_, "Order_price_is_not_multiple_of_ticksize");
+    rejectNewOrderRequest(order_, ExecText::PriceNotTickAligned);
     return;
   }
-  if (not isValidPrice(order_->price())) {
-    INFO("Order price is not a multiple of within threshold (10) of"
-         << LOG_VAR(_closePrice) << LOG_VAR(order_->price()));
-    rejectNewOrderRequest(order_,
-                          "Order_price_is_outside_threshold_of_closePrice");
+  order_.setticks(toTicks(order_.price()));
+  if (not isValidPrice(order_.ticks())) {
+    INFO("Order price is not within threshold of"
+         << LOG_VAR(_closePrice) << LOG_VAR(order_.price())
+         << LOG_NVP("Band", _config.priceBand));
+    rejectNewOrderRequest(order_, ExecText::PriceOutsideThreshold);
     return;
   }
-  auto traderID = order_->traderID();
-  Trader::Ptr trader;
-  if (not isTraderRegistered(traderID)) {
-    trader = registerTrader(traderID);
-  } else {
-    trader = _registeredTraders[order_->traderID()];
+  Trader *trader = findTrader(order_.traderID());
+  if (!trader) {
+    rejectNewOrderRequest(order_, ExecText::TraderOutOfRange);
+    return;
   }
-  if (trader->isRateExceeded()) {
+  if (not trader->isRegistered())
+    trader->registerAt(_clock->nanos(), _config.rateLimit);
+  if (not trader->tryConsume(_clock->nanos(), _config.rateLimit)) {
     INFO("Message rate exceeded for "
-         << LOG_NVP("traderID", order_->traderID()));
-    rejectNewOrderRequest(order_, "Message_rate_exceeded");
+         << LOG_NVP("traderID", order_.traderID()));
+    rejectNewOrderRequest(order_, ExecText::RateExceeded);
     return;
   }
-  acceptNewOrderRequest(order_);
-  orderQueue.push(order_);
-  updateLevel(order_->side(), order_->price(), order_->ordQty());
+  Order *order = _orderPool.acquire(order_);
+  if (!order) {
+    WARN("Order pool exhausted " << LOG_NVP("Capacity", _orderPool.capacity()));
+    rejectNewOrderRequest(order_, ExecText::CapacityExceeded);
+    return;
+  }
+  acceptNewOrderRequest(order);
+  if (_phase == TradingPhase::Continuous)
+    matchAggressor(order);
+  if (order->leavesQty() == 0) {
+    retireOrder(order);
+    centerLadders();
+    return;
+  }
+  getBookSide(order->side()).add(order);
+  updateLevel(order->side(), order->ticks(), order->leavesQty());
+  if (_orderFeed)
+    _orderFeed->publish(OrderEventType::Add, *order, order->leavesQty());
+  centerLadders();
 }
 
-void OrderBook::rejectNewOrderRequest(const Order::Ptr &order_,
-                                      const std::string &reason) {
+void OrderBook::rejectNewOrderRequest(Order &order_, const char *reason) {
   INFO("Rejecting new order request: "
-       << LOG_NVP("OrderID", order_->orderID()) << LOG_VAR(reason)
-       << LOG_NVP("TraderID", order_->traderID()));
-  order_->setstatus(OrdStatus::Rejected);
-  auto execReport = std::make_shared<ExecReport>(order_, ExecType::Reject);
-  execReport->settext(reason);
-  addExecReport(execReport);
+       << LOG_NVP("OrderID", order_.orderID()) << LOG_VAR(reason)
+       << LOG_NVP("TraderID", order_.traderID()));
+  order_.setstatus(OrdStatus::Rejected);
+  addExecReport(order_, ExecType::Reject, reason);
 }
 
-void OrderBook::acceptNewOrderRequest(const Order::Ptr &order_) {
+void OrderBook::acceptNewOrderRequest(Order *order_) {
   INFO("Accepting new order request: " << LOG_NVP("OrderID", order_->orderID())
                                        << LOG_NVP("Side", order_->side())
                                        << LOG_NVP("Price", order_->price())
                                        << LOG_NVP("OrdQty", order_->ordQty()));
   order_->setstatus(OrdStatus::New);
-  _rootOrders[order_->orderID()] = order_;
-  addExecReport(std::make_shared<ExecReport>(order_, ExecType::New));
+  _rootOrders.insert(order_);
+  addExecReport(*order_, ExecType::New);
+  _orderToAck.record(CycleClock::nanosSince(order_->entryCycles()));
 }
 
-void OrderBook::addExecReport(const ExecReport::Ptr &execReport_) {
-  _execReports.push(execReport_);
+void OrderBook::addExecReport(const Order &order_, ExecType execType_,
+                              const char *text_) {
+  ExecReport execReport(order_, execType_);
+  execReport.settext(text_);
+  // numbered before the ring so a dropped report leaves a visible gap
+  execReport.setexecID(++_execIDSeed);
+  execReport.setbookID(_config.bookID);
+  if (not _staging) {
+    publishExecReport(execReport);
+    return;
+  }
+  _staged[_stagedCount++] = execReport;
+  if (_stagedCount == StagedReports)
+    publishStaged();
 }
 
-Order::Ptr OrderBook::findRootOrder(int orderID_) {
-  if (_rootOrders.find(orderID_) == _rootOrders.end())
-    return nullptr;
-  else
-    return _rootOrders[orderID_];
+// the book's single writer is the ring's one producer
+void OrderBook::publishExecReport(const ExecReport &execReport_) {
+  while (not _execReports->tryPush(execReport_)) {
+    if (_config.overflowPolicy == OverflowPolicy::Drop) {
+      ++_droppedExecReports;
+      return;
+    }
+    if (_config.overflowPolicy == OverflowPolicy::Block)
+      std::this_thread::yield();
+  }
 }
 
-void OrderBook::onCancel(const Order::Ptr &order_) {
-  order_->setstatus(OrdStatus::Cancelled);
-  addExecReport(std::make_shared<ExecReport>(order_, ExecType::Cancel));
+void OrderBook::publishStaged() {
+  size_t published(0);
+  while (published < _stagedCount) {
+    published += _execReports->pushBatch(_staged.get() + published,
+                                         _stagedCount - published);
+    if (published == _stagedCount)
+      break;
+    if (_config.overflowPolicy == OverflowPolicy::Drop) {
+      _droppedExecReports += _stagedCount - published;
+      break;
+    }
+    if (_config.overflowPolicy == OverflowPolicy::Block)
+      std::this_thread::yield();
+  }
+  _stagedCount = 0;
+}
+
+void OrderBook::removeOrder(Order *order_) {
+  getBookSide(order_->side()).remove(order_);
+  updateLevel(order_->side(), order_->ticks(), -order_->leavesQty());
+}
+
+void OrderBook::retireOrder(Order *order_) {
   _rootOrders.erase(order_->orderID());
-  updateLevel(order_->side(), order_->price(), order_->leavesQty());
+  _orderPool.release(order_);
+}
+
+void OrderBook::onCancel(Order *order_) {
+  order_->setstatus(OrdStatus::Cancelled);
+  addExecReport(*order_, ExecType::Cancel);
+  if (_orderFeed)
+    _orderFeed->publish(OrderEventType::Cancel, *order_, order_->leavesQty());
+  removeOrder(order_);
+  retireOrder(order_);
 }
 
-void OrderBook::onAmendDown(const Order::Ptr &order_, qty_t newQty_) {
+void OrderBook::onAmendDown(Order *order_, qty_t newQty_) {
   qty_t oldQty = order_->ordQty();
   order_->setordQty(newQty_);
-  addExecReport(std::make_shared<ExecReport>(order_, ExecType::Replaced));
-  updateLevel(order_->side(), order_->price(), newQty_ - oldQty);
+  addExecReport(*order_, ExecType::Replaced);
+  if (_orderFeed)
+    _orderFeed->publish(OrderEventType::Modify, *order_, order_->leavesQty());
+  // amended down to what has already traded, nothing left to rest
+  bool done = order_->leavesQty() == 0;
+  if (done) {
+    order_->setstatus(OrdStatus::Filled);
+    getBookSide(order_->side()).remove(order_);
+  }
+  updateLevel(order_->side(), order_->ticks(), newQty_ - oldQty);
+  if (done)
+    retireOrder(order_);
+}
+
+size_t OrderBook::onOrderBatch(Command *commands_, size_t count_) {
+  if (_config.matchingMode == MatchingMode::Async) {
+    for (size_t i(0); i < count_; i++)
+      if (commands_[i].type == CommandType::NewOrder)
+        commands_[i].order.setEntryTimeNow();
+    size_t queued = _commands.tryPushBatch(commands_, count_);
+    if (queued)
+      _workSignal.notify();
+    return queued;
+  }
+  updateOwnClock();
+  serviceSnapshot();
+  beginStaging();
+  for (size_t i(0); i < count_; i++) {
+    if (commands_[i].type == CommandType::NewOrder)
+      commands_[i].order.setEntryTimeNow();
+    processCommand(commands_[i]);
+  }
+  endStaging();
+  return count_;
+}
+
+void OrderBook::onQueuedCommand(Command &command_) {
+  updateOwnClock();
+  serviceSnapshot();
+  processCommand(command_);
 }
 
-void OrderBook::onOrderCancelRequest(const Order::Ptr &order_) {
-  std::lock_guard<decltype(_mutex)> lock(_mutex);
-  auto traderID = order_->traderID();
-  if (not isTraderRegistered(traderID)) {
-    rejectCancelRequest(order_, "Trader_not_registered.");
+bool OrderBook::startAuction() {
+  Command command{CommandType::StartAuction, Order()};
+  if (_config.matchingMode == MatchingMode::Async)
+    return submitCommand(command.type, command.order);
+  updateOwnClock();
+  serviceSnapshot();
+  processCommand(command);
+  return true;
+}
+
+bool OrderBook::uncross() {
+  Command command{CommandType::Uncross, Order()};
+  if (_config.matchingMode == MatchingMode::Async)
+    return submitCommand(command.type, command.order);
+  updateOwnClock();
+  serviceSnapshot();
+  processCommand(command);
+  return true;
+}
+
+bool OrderBook::onOrderCancelRequest(const Order &order_) {
+  if (_config.matchingMode == MatchingMode::Async)
+    return submitCommand(CommandType::CancelOrder, order_);
+  updateOwnClock();
+  serviceSnapshot();
+  processCancelRequest(order_);
+  return true;
+}
+
+void OrderBook::processCancelRequest(const Order &order_) {
+  Trader *trader = findTrader(order_.traderID());
+  if (!trader || not trader->isRegistered()) {
+    rejectCancelRequest(order_, ExecText::TraderNotRegistered);
     return;
   }
-  if (_registeredTraders[traderID]->isRateExceeded()) {
-    rejectCancelRequest(order_, "Message_rate_exceeded");
+  if (not trader->tryConsume(_clock->nanos(), _config.rateLimit)) {
+    rejectCancelRequest(order_, ExecText::RateExceeded);
+    return;
+  }
+  // zero cancels, anything below it is malformed
+  if (order_.ordQty() < 0) {
+    rejectCancelRequest(order_, ExecText::QtyNotPositive);
+    return;
   }
 
-  auto originalOrder = findRootOrder(order_->orderID());
+  // filled and cancelled orders are retired, so anything found is resting
+  auto originalOrder = findRootOrder(order_.orderID());
   if (!originalOrder) {
-    rejectCancelRequest(order_, "Order_not_found.");
+    rejectCancelRequest(order_, ExecText::OrderNotFound);
     return;
   }
-  qty_t newQty = order_->ordQty();
+  qty_t newQty = order_.ordQty();
   qty_t oldQty = originalOrder->cumQty();
   if (newQty < oldQty) {
-    rejectCancelRequest(originalOrder, "Quantity_amend_up_is_not_allowed");
+    rejectCancelRequest(*originalOrder, ExecText::AmendUpNotAllowed);
     return;
   }
 
   if (newQty == 0) {
     onCancel(originalOrder);
-  } else if (newQty < order_->cumQty()) {
-    rejectCancelRequest(originalOrder, "Too_late_to_cancel");
+  } else if (newQty < order_.cumQty()) {
+    rejectCancelRequest(*originalOrder, ExecText::TooLateToCancel);
     onCancel(originalOrder);
   } else {
     onAmendDown(originalOrder, newQty);
   }
+  centerLadders();
 }
 
-bool OrderBook::canCross(const Order::Ptr &buy_, const Order::Ptr &sell_) {
-  if (greater_equal(buy_->price(), sell_->price()))
-    return true;
-  else
-    return false;
+bool OrderBook::canCross(const Order *buy_, const Order *sell_) {
+  return buy_->ticks() >= sell_->ticks();
 }
 
-ExecReport::Ptr OrderBook::getExecMessage() {
-  std::lock_guard<decltype(_mutex)> lock(_mutex);
-  if (_execReports.empty())
-    return nullptr;
-  auto execReport = _execReports.front();
-  _execReports.pop();
+std::optional<ExecReport> OrderBook::getExecMessage() {
+  ExecReport execReport;
+  if (not _execReports->tryPop(execReport))
+    return std::nullopt;
   return execReport;
 }
 
-void OrderBook::onTrade(Order::Ptr &buyOrder_, Order::Ptr &sellOrder_,
-                        price_t crossPx_, qty_t crossQty_) {
+size_t OrderBook::getExecMessages(ExecReport *out_, size_t max_) {
+  return _execReports->popBatch(out_, max_);
+}
+
+void OrderBook::onTrade(Order *buyOrder_, Order *sellOrder_,
+                        ticks_t crossTicks_, price_t crossPx_,
+                        qty_t crossQty_, bool auction_) {
   INFO("Trade: " << LOG_NVP("Price", crossPx_)
                  << LOG_NVP("Quantity", crossQty_));
-  buyOrder_->setlastPrice(crossPx_);
-  sellOrder_->setlastPrice(crossPx_);
+  buyOrder_->setlastPrice(crossTicks_, crossPx_);
+  sellOrder_->setlastPrice(crossTicks_, crossPx_);
   buyOrder_->setlastQty(crossQty_);
   sellOrder_->setlastQty(crossQty_);
-  buyOrder_->setstatus(OrdStatus::PartiallyFilled);
-  sellOrder_->setstatus(OrdStatus::PartiallyFilled);
-  if (buyOrder_->leavesQty() == 0) {
-    // finalise order
-    buyOrder_->setstatus(OrdStatus::Filled);
-    _buyOrders.pop();
-  }
-  if (sellOrder_->leavesQty() == 0) {
-    // finalise order
-    sellOrder_->setstatus(OrdStatus::Filled);
-    _sellOrders.pop();
-  }
+  // finalise orders with nothing left
+  buyOrder_->setstatus(buyOrder_->leavesQty() == 0
+                           ? OrdStatus::Filled
+                           : OrdStatus::PartiallyFilled);
+  sellOrder_->setstatus(sellOrder_->leavesQty() == 0
+                            ? OrdStatus::Filled
+                            : OrdStatus::PartiallyFilled);
   // send exec reports
-  auto execReport = std::make_shared<ExecReport>(sellOrder_, ExecType::Trade);
-  addExecReport(execReport);
-  execReport = std::make_shared<ExecReport>(buyOrder_, ExecType::Trade);
-  addExecReport(execReport);
-  updateLevel(Side::Buy, buyOrder_->price(), -crossQty_);
-  updateLevel(Side::Sell, sellOrder_->price(), -crossQty_);
-  _tradedVolume += crossQty_;
-}
-
-Order::Ptr OrderBook::getLiveOrder(Side side_) {
-  auto &orderQueue = getOrderQueue(side_);
-  Order::Ptr order;
-  while (!orderQueue.empty()) {
-    order = orderQueue.top();
-    if (not order)
+  addExecReport(*sellOrder_, ExecType::Trade);
+  addExecReport(*buyOrder_, ExecType::Trade);
+  if (auction_) {
+    // both orders were resting
+    if (_orderFeed) {
+      _orderFeed->publish(OrderEventType::Execute, *buyOrder_, crossQty_,
+                          sellOrder_->orderID());
+      _orderFeed->publish(OrderEventType::Execute, *sellOrder_, crossQty_,
+                          buyOrder_->orderID());
+    }
+    return;
+  }
+  Order *aggressor = buyOrder_->isResting() ? sellOrder_ : buyOrder_;
+  if (aggressor->cumQty() == crossQty_)
+    _orderToFirstFill.record(
+        CycleClock::nanosSince(aggressor->entryCycles()));
+  if (_orderFeed) {
+    // the aggressor only shows on the feed once it rests
+    bool buyRests = buyOrder_->isResting();
+    _orderFeed->publish(OrderEventType::Execute,
+                        buyRests ? *buyOrder_ : *sellOrder_, crossQty_,
+                        buyRests ? sellOrder_->orderID()
+                                 : buyOrder_->orderID());
+  }
+}
+
+void OrderBook::matchAggressor(Order *order_) {
+  bool isBuy = order_->side() == Side::Buy;
+  auto &contraSide = getBookSide(isBuy ? Side::Sell : Side::Buy);
+  qty_t sweptQty(0);
+  // walk the contra side a level at a time, filling its orders in time
+  // priority, and only touch the level totals once per level
+  while (order_->leavesQty() > 0 && not contraSide.empty()) {
+    PriceLevel &level = *contraSide.best();
+    ticks_t restingTicks = contraSide.bestTicks();
+    Order *front = level.front();
+    if (not canCross(isBuy ? order_ : front, isBuy ? front : order_))
       break;
-    if (order->isCancelled()) {
-      orderQueue.pop();
-      continue;
+    auto crossTicks = std::min(order_->ticks(), restingTicks);
+    auto crossPx = toPrice(crossTicks);
+    qty_t levelQty(0);
+    // a level outside the window goes with its last order, so it is not
+    // looked at again once that has been removed
+    bool levelDone(false);
+    while (order_->leavesQty() > 0 && not levelDone) {
+      Order *resting = level.front();
+      auto crossQty = std::min(order_->leavesQty(), resting->leavesQty());
+      if (isBuy)
+        onTrade(order_, resting, crossTicks, crossPx, crossQty);
+      else
+        onTrade(resting, order_, crossTicks, crossPx, crossQty);
+      levelQty += crossQty;
+      if (resting->leavesQty() == 0) {
+        levelDone = level.count() == 1;
+        contraSide.remove(resting);
+        retireOrder(resting);
+      }
     }
-    return order;
+    updateLevel(contraSide.side(), restingTicks, -levelQty);
+    sweptQty += levelQty;
   }
-  return nullptr;
+  _tradedVolume += sweptQty;
+}
+
+void OrderBook::rejectCancelRequest(const Order &order_,
+                                    const char *reason_) {
+  addExecReport(order_, ExecType::CancelReject, reason_);
+}
+
+price_t OrderBook::bestBid() const {
+  if (_buyLevels.empty())
+    return -1;
+  return toPrice(_buyLevels.bestTicks());
+}
+
+price_t OrderBook::bestAsk() const {
+  if (_sellLevels.empty())
+    return -1;
+  return toPrice(_sellLevels.bestTicks());
+}
+
+bool OrderBook::requestSnapshot(BookSnapshot *into_) {
+  BookSnapshot *expected = nullptr;
+  if (not _snapshotRequest.compare_exchange_strong(expected, into_))
+    return false;
+  if (_config.matchingMode == MatchingMode::Async)
+    _workSignal.notify();
+  return true;
+}
+
+bool OrderBook::cancelSnapshot(BookSnapshot *into_) {
+  return _snapshotRequest.compare_exchange_strong(into_, nullptr);
 }
 
-void OrderBook::match() {
-  std::lock_guard<decltype(_mutex)> lock(_mutex);
-  if (_buyOrders.empty() || _sellOrders.empty()) {
+void OrderBook::takeSnapshot() {
+  BookSnapshot *snapshot =
+      _snapshotRequest.exchange(nullptr, std::memory_order_acquire);
+  if (!snapshot)
     return;
+  captureSnapshot(*snapshot);
+  _snapshotsTaken.fetch_add(1, std::memory_order_release);
+}
+
+void OrderBook::captureSnapshot(BookSnapshot &out_) const {
+  SnapshotHeader &header = out_.header;
+  header = SnapshotHeader{};
+  std::memcpy(header.magic, SnapshotHeader::Magic, sizeof(header.magic));
+  header.version = SnapshotHeader::Version;
+  header.orderSize = sizeof(SnapshotOrder);
+  // always leave room for the terminator
+  std::memcpy(header.symbol, _symbol.data(),
+              std::min(_symbol.size(), sizeof(header.symbol) - 1));
+  header.ticksPerUnit = _ticksPerUnit;
+  header.closeTicks = _closeTicks;
+  header.sequence = _execIDSeed;
+  header.tradedVolume = _tradedVolume;
+  header.oidSeed = _oidSeed;
+  header.phase = static_cast<uint32_t>(_phase);
+  // sized once, later captures reuse the capacity
+  out_.orders.clear();
+  out_.orders.reserve(_orderPool.capacity());
+  for (const BookSide *side : {&_buyLevels, &_sellLevels}) {
+    bool isBuy = side == &_buyLevels;
+    for (ticks_t ticks = side->bestTicks(); ticks != BookSide::npos;
+         ticks = isBuy ? side->nextBelow(ticks) : side->nextAbove(ticks)) {
+      for (const Order *order = side->level(ticks)->front(); order;
+           order = order->next()) {
+        SnapshotOrder saved{};
+        saved.ticks = order->ticks();
+        saved.ordQty = order->ordQty();
+        saved.cumQty = order->cumQty();
+        saved.lastTicks = order->lastTicks();
+        saved.lastQty = order->lastQty();
+        saved.orderID = order->orderID();
+        saved.traderID = order->traderID();
+        saved.side = static_cast<uint8_t>(order->side());
+        saved.status = static_cast<uint8_t>(order->status());
+        out_.orders.push_back(saved);
+      }
+    }
+  }
+  out_.traders.clear();
+  for (size_t traderID(0); traderID < _traders.size(); traderID++)
+    if (_traders[traderID].isRegistered())
+      out_.traders.push_back(static_cast<int32_t>(traderID));
+  header.orders = out_.orders.size();
+  header.traders = out_.traders.size();
+}
+
+bool OrderBook::restore(const BookSnapshot &snapshot_) {
+  const SnapshotHeader &header = snapshot_.header;
+  std::string symbol(header.symbol,
+                     strnlen(header.symbol, sizeof(header.symbol)));
+  if (symbol != _symbol || header.ticksPerUnit != _ticksPerUnit ||
+      header.closeTicks != _closeTicks) {
+    ERROR("Snapshot is for another book " << LOG_NVP("Symbol", symbol)
+                                          << LOG_NVP("Book", _symbol));
+    return false;
+  }
+  if (_execIDSeed != 0 || not _rootOrders.empty()) {
+    ERROR("Snapshot can only be restored into an empty book "
+          << LOG_NVP("Symbol", _symbol));
+    return false;
   }
-  auto buyOrder = getLiveOrder(Side::Buy);
-  auto sellOrder = getLiveOrder(Side::Sell);
-  if (!buyOrder || !sellOrder)
+  for (int traderID : snapshot_.traders)
+    registerTrader(traderID);
+  for (const SnapshotOrder &saved : snapshot_.orders) {
+    auto side = static_cast<Side>(saved.side);
+    Order *order = _orderPool.acquire(side, saved.ordQty, toPrice(saved.ticks));
+    if (!order) {
+      ERROR("Order pool too small for snapshot "
+            << LOG_NVP("Capacity", _orderPool.capacity())
+            << LOG_NVP("Orders", snapshot_.orders.size()));
+      return false;
+    }
+    order->setorderID(saved.orderID);
+    order->settraderID(saved.traderID);
+    order->setticks(saved.ticks);
+    order->setstatus(static_cast<OrdStatus>(saved.status));
+    order->setlastPrice(saved.lastTicks, toPrice(saved.lastTicks));
+    order->restoreFills(saved.cumQty, saved.lastQty);
+    _rootOrders.insert(order);
+    // saved in time priority, so appending rebuilds each queue as it was
+    getBookSide(side).add(order);
+    updateLevel(side, order->ticks(), order->leavesQty());
+  }
+  centerLadders();
+  _oidSeed = header.oidSeed;
+  _execIDSeed = static_cast<int>(header.sequence);
+  _tradedVolume = header.tradedVolume;
+  _phase = header.phase == static_cast<uint32_t>(TradingPhase::Auction)
+               ? TradingPhase::Auction
+               : TradingPhase::Continuous;
+  return true;
+}
+
+// Reports are applied as the book produced them. A new order's trades
+// follow its New report, so it is held back as the aggressor and only rests
+// once the next request's reports begin.
+void OrderBook::replayReport(const ExecReport &report_) {
+  if (report_.execID() <= _execIDSeed)
     return;
-  if (canCross(buyOrder, sellOrder)) {
-    auto crossQty = std::min(buyOrder->leavesQty(), sellOrder->leavesQty());
-    auto crossPx = std::min(buyOrder->price(), sellOrder->price());
-    onTrade(buyOrder, sellOrder, crossPx, crossQty);
+  _execIDSeed = report_.execID();
+  if (report_.execType() != ExecType::Trade)
+    endReplay();
+  auto traderID = report_.traderID();
+  switch (report_.execType()) {
+  case ExecType::New: {
+    _oidSeed = std::max(_oidSeed, report_.orderID());
+    registerTrader(traderID);
+    Order *order = _orderPool.acquire(report_.side(), report_.ordQty(),
+                                      toPrice(report_.ticks()));
+    if (!order) {
+      ERROR("Order pool exhausted replaying journal "
+            << LOG_NVP("Capacity", _orderPool.capacity()));
+      return;
+    }
+    order->setorderID(report_.orderID());
+    order->settraderID(traderID);
+    order->setticks(report_.ticks());
+    order->setstatus(OrdStatus::New);
+    _rootOrders.insert(order);
+    _replayAggressor = order;
+    break;
   }
+  case ExecType::Reject:
+    _oidSeed = std::max(_oidSeed, report_.orderID());
+    // the trader was registered before these checks
+    if (ExecText::same(report_.text(), ExecText::RateExceeded) ||
+        ExecText::same(report_.text(), ExecText::CapacityExceeded))
+      registerTrader(traderID);
+    break;
+  case ExecType::Trade: {
+    Order *order = findRootOrder(report_.orderID());
+    if (!order)
+      return;
+    order->setlastPrice(report_.lastTicks(), report_.lastPrice());
+    order->setlastQty(report_.lastQty());
+    order->setstatus(report_.ordStatus());
+    // every cross reports one buy fill, in continuous trading or an auction
+    if (order->side() == Side::Buy)
+      _tradedVolume += report_.lastQty();
+    if (not order->isResting())
+      return;
+    bool done = order->leavesQty() == 0;
+    if (done)
+      getBookSide(order->side()).remove(order);
+    updateLevel(order->side(), order->ticks(), -report_.lastQty());
+    if (done)
+      retireOrder(order);
+    break;
+  }
+  case ExecType::Replaced: {
+    Order *order = findRootOrder(report_.orderID());
+    if (!order)
+      return;
+    qty_t oldQty = order->ordQty();
+    order->setordQty(report_.ordQty());
+    bool done = order->leavesQty() == 0;
+    if (done) {
+      order->setstatus(OrdStatus::Filled);
+      getBookSide(order->side()).remove(order);
+    }
+    updateLevel(order->side(), order->ticks(), report_.ordQty() - oldQty);
+    if (done)
+      retireOrder(order);
+    break;
+  }
+  case ExecType::Cancel: {
+    Order *order = findRootOrder(report_.orderID());
+    if (!order)
+      return;
+    order->setstatus(OrdStatus::Cancelled);
+    removeOrder(order);
+    retireOrder(order);
+    break;
+  }
+  case ExecType::Phase:
+    _phase = ExecText::same(report_.text(), ExecText::AuctionStarted)
+                 ? TradingPhase::Auction
+                 : TradingPhase::Continuous;
+    break;
+  default:
+    break;
+  }
+  centerLadders();
 }
 
-void OrderBook::rejectCancelRequest(const Order::Ptr &order_,
-                                    const std::string &reason_) {
-  auto execReport =
-      std::make_shared<ExecReport>(order_, ExecType::CancelReject);
-  execReport->settext(reason_);
-  addExecReport(execReport);
+void OrderBook::endReplay() {
+  Order *order = std::exchange(_replayAggressor, nullptr);
+  if (!order)
+    return;
+  if (order->leavesQty() == 0) {
+    retireOrder(order);
+    return;
+  }
+  getBookSide(order->side()).add(order);
+  updateLevel(order->side(), order->ticks(), order->leavesQty());
+  centerLadders();
 }
 
-price_t OrderBook::bestBid() const {
-  for (size_t i(_buyLevels.size() - 1); i >= 0; i--) {
-    if (_buyLevels[i] != 0)
-      return (i * _tickSize) + std::max(_closePrice - 10, 0.0);
+// Demand at a price is all buy quantity at or above it, supply all sell
+// quantity at or below it, and what can trade there is the smaller of the
+// two. Only prices between the best ask and the best bid can trade at all,
+// and across them demand and supply only change at levels with orders, so
+// the range is gathered into runs: each such level, and each gap of empty
+// prices between two of them. A gap adds nothing of its own, the prefix sums
+// give it the supply of the level below and the demand of the level above.
+// Each pass is a plain loop over contiguous arrays. The prefix sums, running
+// one way for supply and the other for demand, are scalar: every element
+// waits on the one before it. That is cheap here, there is one run per
+// occupied level in the crossed range plus the gaps between them, never the
+// whole ladder. The element wise volume pass and the reductions choosing the
+// price have no such chain and are left for the compiler to vectorize.
+AuctionUncross OrderBook::indicativeUncross() {
+  AuctionUncross result;
+  if (_buyLevels.empty() || _sellLevels.empty() ||
+      _buyLevels.bestTicks() < _sellLevels.bestTicks())
+    return result;
+  auto qtyAt = [](const BookSide &side_, ticks_t ticks_) {
+    const PriceLevel *level = side_.level(ticks_);
+    return level ? level->qty() : 0;
+  };
+  auto addRun = [this](ticks_t low_, ticks_t high_, qty_t buy_,
+                       qty_t sell_) {
+    _auctionLow.push_back(low_);
+    _auctionHigh.push_back(high_);
+    _auctionDemand.push_back(buy_);
+    _auctionSupply.push_back(sell_);
+  };
+  _auctionLow.clear();
+  _auctionHigh.clear();
+  _auctionDemand.clear();
+  _auctionSupply.clear();
+  ticks_t top = _buyLevels.bestTicks();
+  for (ticks_t ticks = _sellLevels.bestTicks(); ticks <= top;) {
+    addRun(ticks, ticks, qtyAt(_buyLevels, ticks), qtyAt(_sellLevels, ticks));
+    ticks_t next = std::min(_buyLevels.nextAbove(ticks),
+                            _sellLevels.nextAbove(ticks));
+    if (next <= top && next > ticks + 1)
+      addRun(ticks + 1, next - 1, 0, 0);
+    ticks = next;
+  }
+  size_t count = _auctionLow.size();
+  _auctionVolume.resize(count);
+  qty_t *demand = _auctionDemand.data();
+  qty_t *supply = _auctionSupply.data();
+  qty_t *volume = _auctionVolume.data();
+  for (size_t i(1); i < count; i++)
+    supply[i] += supply[i - 1];
+  for (size_t i(count - 1); i-- > 0;)
+    demand[i] += demand[i + 1];
+  qty_t maxVolume(0);
+  for (size_t i(0); i < count; i++) {
+    volume[i] = std::min(demand[i], supply[i]);
+    maxVolume = std::max(maxVolume, volume[i]);
   }
-  return -1;
+  qty_t minImbalance = std::numeric_limits<qty_t>::max();
+  for (size_t i(0); i < count; i++) {
+    qty_t imbalance = std::abs(demand[i] - supply[i]);
+    minImbalance = volume[i] == maxVolume
+                       ? std::min(minImbalance, imbalance)
+                       : minImbalance;
+  }
+  // the close breaks what ties remain, the lower price if still level.
+  // Within a run the price nearest the close is the one that counts.
+  size_t best(0);
+  ticks_t bestTicks(0);
+  ticks_t bestDistance = std::numeric_limits<ticks_t>::max();
+  for (size_t i(0); i < count; i++) {
+    if (volume[i] != maxVolume ||
+        std::abs(demand[i] - supply[i]) != minImbalance)
+      continue;
+    ticks_t ticks = std::clamp(_closeTicks, _auctionLow[i], _auctionHigh[i]);
+    ticks_t distance = std::abs(ticks - _closeTicks);
+    if (distance < bestDistance) {
+      best = i;
+      bestTicks = ticks;
+      bestDistance = distance;
+    }
+  }
+  result.ticks = bestTicks;
+  result.price = toPrice(result.ticks);
+  result.volume = maxVolume;
+  result.imbalance = demand[best] - supply[best];
+  return result;
 }
 
-price_t OrderBook::bestAsk() const {
-  for (size_t i(0); i < _sellLevels.size(); i++) {
-    if (_sellLevels[i] != 0)
-      return (i * _tickSize) + std::max(_closePrice - 10, 0.0);
+void OrderBook::processUncross() {
+  auto uncross = indicativeUncross();
+  INFO("Auction uncross " << LOG_NVP("Symbol", _symbol)
+                          << LOG_NVP("Price", uncross.price)
+                          << LOG_NVP("Volume", uncross.volume)
+                          << LOG_NVP("Imbalance", uncross.imbalance));
+  // a batch of its own unless already inside one
+  bool staging = _staging;
+  if (not staging)
+    beginStaging();
+  // ahead of the fills, which replay then applies to resting orders
+  Order phase;
+  phase.setlastPrice(uncross.ticks, uncross.price);
+  phase.setlastQty(uncross.volume);
+  addExecReport(phase, ExecType::Phase, ExecText::AuctionUncrossed);
+  if (uncross.volume > 0)
+    executeAuction(uncross);
+  if (not staging)
+    endStaging();
+  _phase = TradingPhase::Continuous;
+  centerLadders();
+}
+
+// Fills both sides best price first and in time priority within a level,
+// all at the uncross price, until the uncross volume has traded. Level
+// totals are only touched once per level.
+void OrderBook::executeAuction(const AuctionUncross &uncross_) {
+  qty_t remaining = uncross_.volume;
+  qty_t buyLevelQty(0), sellLevelQty(0);
+  while (remaining > 0) {
+    ticks_t buyTicks = _buyLevels.bestTicks();
+    ticks_t sellTicks = _sellLevels.bestTicks();
+    Order *buy = _buyLevels.best()->front();
+    Order *sell = _sellLevels.best()->front();
+    qty_t qty = std::min({remaining, buy->leavesQty(), sell->leavesQty()});
+    onTrade(buy, sell, uncross_.ticks, uncross_.price, qty, true);
+    remaining -= qty;
+    buyLevelQty += qty;
+    sellLevelQty += qty;
+    for (Order *order : {buy, sell}) {
+      if (order->leavesQty() > 0)
+        continue;
+      BookSide &side = getBookSide(order->side());
+      bool lastAtLevel = order->level()->count() == 1;
+      side.remove(order);
+      retireOrder(order);
+      if (not lastAtLevel)
+        continue;
+      bool isBuy = &side == &_buyLevels;
+      updateLevel(side.side(), isBuy ? buyTicks : sellTicks,
+                  -(isBuy ? buyLevelQty : sellLevelQty));
+      (isBuy ? buyLevelQty : sellLevelQty) = 0;
+    }
   }
-  return -1;
+  if (buyLevelQty)
+    updateLevel(Side::Buy, _buyLevels.bestTicks(), -buyLevelQty);
+  if (sellLevelQty)
+    updateLevel(Side::Sell, _sellLevels.bestTicks(), -sellLevelQty);
+  _tradedVolume += uncross_.volume;
 }
@@ -1,78 +1,298 @@
 #pragma once
+#include <atomic>
 #include <ctime>
-#include <mutex>
-#include <queue>
+#include <memory>
+#include <optional>
 #include <thread>
-#include <unordered_map>
 #include <vector>
 
+#include "BookSide.h"
+#include "DepthFeed.h"
+#include "LatencyHistogram.h"
 #include "Domain.h"
+#include "MpscQueue.h"
+#include "ObjectPool.h"
+#include "OrderFeed.h"
+#include "OrderIndex.h"
+#include "SpscRing.h"
+#include "WorkSignal.h"
 
+// what the book does when the exec report ring is full
+ENUM_MACRO_3(OverflowPolicy, Block, Spin, Drop)
+// Inline processes each request on the calling thread, Async queues them for
+// an engine thread run between start() and stop()
+ENUM_MACRO_2(MatchingMode, Inline, Async)
+ENUM_MACRO_4(CommandType, NewOrder, CancelOrder, StartAuction, Uncross)
+// in an Auction orders rest without matching until the book is uncrossed
+ENUM_MACRO_2(TradingPhase, Continuous, Auction)
+
+// where an auction would uncross
+struct AuctionUncross {
+  ticks_t ticks = 0;
+  price_t price = 0;
+  // zero when the book is not crossed
+  qty_t volume = 0;
+  // buy less sell quantity willing to trade at the price
+  qty_t imbalance = 0;
+};
+
+struct BookSnapshot;
+
+struct BookConfig {
+  size_t maxOrders = 65536;
+  // orders priced further than this from the close are rejected, zero for
+  // no band
+  price_t priceBand = 10;
+  // levels each side keeps in a dense window around its touch, rounded up
+  // to a power of two. Levels further out are held sparsely, in map nodes
+  // from a pool of maxOrders blocks shared by both sides, allocated with
+  // the book.
+  size_t ladderWindow = 4096;
+  size_t maxExecReports = 65536;
+  // requests queued for the engine thread in Async mode
+  size_t maxPendingCommands = 65536;
+  OverflowPolicy overflowPolicy = OverflowPolicy::Block;
+  MatchingMode matchingMode = MatchingMode::Inline;
+  // how the engine thread idles in Async mode
+  WaitStrategy waitStrategy = WaitStrategy::Block;
+  DepthFeedMode depthFeedMode = DepthFeedMode::Off;
+  // Incremental updates the consumer may fall behind by before they drop
+  size_t depthFeedCapacity = 65536;
+  // market by order events, off when zero
+  size_t orderFeedCapacity = 0;
+  // stamped on every exec report, tells apart books sharing a report stream
+  uint32_t bookID = 0;
+  // trader IDs index the trader table directly and must be below this
+  size_t maxTraders = 65536;
+  RateLimit rateLimit;
+  // time for rate limits, updated by whatever loop drives the book, e.g. a
+  // MatchingEngine shard. Null for the book's own clock, which it updates
+  // once per engine loop in Async mode and once per request in Inline mode.
+  const CoarseClock *clock = nullptr;
+};
+
+// All book state is owned by a single writer: the calling thread in Inline
+// mode, the engine thread in Async mode. In Async mode any number of client
+// threads may submit requests, they are handed over through a lock free queue
+// and the book itself takes no locks.
 class OrderBook {
+public:
+  // one request of a batch, a CancelOrder with a non zero quantity amends
+  // the order down to it
+  struct Command {
+    CommandType type = CommandType::Unknown;
+    Order order;
+  };
 
-  using OrderQueue =
-      std::priority_queue<Order::Ptr, std::vector<Order::Ptr>, OrderCompare>;
-  using Traders = std::unordered_map<int, Trader::Ptr>;
-  using RootOrderMap = std::unordered_map<int, Order::Ptr>;
+private:
+  // exec reports held back while a batch runs, published together
+  static constexpr size_t StagedReports = 1024;
 
-  OrderQueue _buyOrders;
-  OrderQueue _sellOrders;
-  RootOrderMap _rootOrders;
-  Traders _registeredTraders;
+
+  ObjectPool<Order> _orderPool;
+  // resting orders by ID, filled and cancelled ones are retired
+  OrderIndex _rootOrders;
+  std::vector<Trader> _traders;
+  CoarseClock _ownClock;
+  const CoarseClock *_clock;
   price_t _tickSize;
-  std::queue<ExecReport::Ptr> _execReports;
+  std::unique_ptr<SpscRing<ExecReport>> _ownExecReports;
+  SpscRing<ExecReport> *_execReports;
+  BookConfig _config;
   int _oidSeed;
+  int _execIDSeed;
   std::string _symbol;
   price_t _closePrice;
-  std::vector<qty_t> _buyLevels;
-  std::vector<qty_t> _sellLevels;
-  std::mutex _mutex;
-  bool _open;
-  std::thread _matchingThread;
+  ticks_t _ticksPerUnit;
+  ticks_t _closeTicks;
+  ticks_t _bandTicks;
+  // far levels of both sides, at most one per resting order
+  NodePool _farLevelNodes;
+  BookSide _buyLevels;
+  BookSide _sellLevels;
+  std::atomic<bool> _open;
+  std::thread _engineThread;
+  MpscQueue<Command> _commands;
+  WorkSignal _workSignal;
+  std::unique_ptr<DepthFeed> _depthFeed;
+  std::unique_ptr<OrderFeed> _orderFeed;
+  LatencyHistogram _orderToAck;
+  LatencyHistogram _orderToFirstFill;
   qty_t _tradedVolume;
+  size_t _droppedExecReports;
+  // handed over by requestSnapshot, taken by the writer between requests
+  std::atomic<BookSnapshot *> _snapshotRequest;
+  std::atomic<size_t> _snapshotsTaken;
+  // during journal replay, the last new order until its trades are applied
+  Order *_replayAggressor;
+  std::unique_ptr<ExecReport[]> _staged;
+  size_t _stagedCount;
+  bool _staging;
+  TradingPhase _phase;
+  // per run scratch for the uncross, a run being a level or the gap between
+  // two. Kept between auctions so they only allocate to grow.
+  std::vector<ticks_t> _auctionLow;
+  std::vector<ticks_t> _auctionHigh;
+  std::vector<qty_t> _auctionDemand;
+  std::vector<qty_t> _auctionSupply;
+  std::vector<qty_t> _auctionVolume;
 
 public:
   using Ptr = std::shared_ptr<OrderBook>;
-  OrderBook(std::string symbol_, price_t closePrice_);
+  // Books normally own their exec report ring. Several books driven from one
+  // writer thread may instead publish into a shared ring, which must outlive
+  // them; maxExecReports is then ignored.
+  OrderBook(std::string symbol_, price_t closePrice_,
+            const BookConfig &config_ = BookConfig(),
+            SpscRing<ExecReport> *sharedExecReports_ = nullptr);
   ~OrderBook();
 
-  void onOrderSingle(Order::Ptr &order_);
-  void onOrderCancelRequest(const Order::Ptr &order_);
+  // the book works on its own pooled copy. In Inline mode the caller's order
+  // is updated with the assigned order ID, in Async mode the ID is only known
+  // once the New exec report is published. Both return false if an Async
+  // request could not be queued.
+  bool onOrderSingle(Order &order_);
+  bool onOrderCancelRequest(const Order &order_);
+  // Takes a batch of requests, processed in order as if sent one by one,
+  // with their exec reports published to the ring together. In Inline mode
+  // the whole batch is processed on the calling thread, new orders get
+  // their IDs as with onOrderSingle, and count_ is returned. In Async mode
+  // the batch is queued with a single claim on the command queue and the
+  // engine thread processes it in one go; the return is how many leading
+  // commands fitted in the queue, the caller resubmits the rest.
+  size_t onOrderBatch(Command *commands_, size_t count_);
+  // For an Inline book whose owner queues requests itself, as the matching
+  // engine's shards do. Processed as the matching on* call would, but new
+  // orders keep the entry time stamped when they were queued, so order to
+  // ack covers the time spent waiting.
+  void onQueuedCommand(Command &command_);
+
+  // Call auction. After startAuction new orders rest without matching,
+  // cancels and amends work as usual. uncross trades everything that
+  // crosses at a single price, the one with the most volume, then the
+  // least imbalance, then the closest to the close, and returns the book to
+  // continuous trading. Both are requests like any other, queued in Async
+  // mode and returning false if the queue is full.
+  bool startAuction();
+  bool uncross();
+  TradingPhase phase() const { return _phase; }
+  // where uncross would trade now, only from the writer or while stopped
+  AuctionUncross indicativeUncross();
+
+  // Snapshots are captured by the writer at its next request boundary: the
+  // engine thread in Async mode, otherwise the next caller of onOrderSingle
+  // or onOrderCancelRequest. requestSnapshot returns false while another
+  // request is pending. cancelSnapshot withdraws a request the writer has
+  // not yet taken, if it already has wait for snapshotsTaken to move on.
+  bool requestSnapshot(BookSnapshot *into_);
+  bool cancelSnapshot(BookSnapshot *into_);
+  size_t snapshotsTaken() const { return _snapshotsTaken; }
+  // only from the writer, or while the book is stopped
+  void captureSnapshot(BookSnapshot &out_) const;
+
+  // Recovery, on a book that has not been started. restore loads a snapshot
+  // into an empty book. replayReport applies a journalled exec report past
+  // sequence() without publishing anything, and endReplay settles the last
+  // replayed order once the journal runs out.
+  bool restore(const BookSnapshot &snapshot_);
+  void replayReport(const ExecReport &report_);
+  void endReplay();
+  // exec ID of the last report published or replayed
+  int sequence() const { return _execIDSeed; }
 
 private:
-  void matchingRoutine();
-  void updateLevel(Side side_, price_t price_, qty_t qty_);
-  bool isTraderRegistered(int traderID_);
-  Trader::Ptr registerTrader(int traderID_);
-  void acceptNewOrderRequest(const Order::Ptr &order_);
-  void rejectNewOrderRequest(const Order::Ptr &order_,
-                             const std::string &reason_);
-  void rejectCancelRequest(const Order::Ptr &order_,
-                           const std::string &reason_);
-  Order::Ptr findRootOrder(int orderID_);
-  void addExecReport(const ExecReport::Ptr &report_);
-  void onAmendDown(const Order::Ptr &order_, qty_t newQty_);
-
-  void onTrade(Order::Ptr &buyOrder_, Order::Ptr &sellOrder_, price_t crossPx_,
-               qty_t crossQty_);
-  void onCancel(const Order::Ptr &order_);
-  void match();
-  static bool canCross(const Order::Ptr &buyOrder_,
-                       const Order::Ptr &sellOrder_);
-  Order::Ptr getLiveOrder(Side side_);
-  OrderQueue &getOrderQueue(Side side_);
+  void engineRoutine();
+  void serviceSnapshot() {
+    if (_snapshotRequest.load(std::memory_order_relaxed))
+      takeSnapshot();
+  }
+  void takeSnapshot();
+  // between requests, once either side's best has drifted off its window
+  void centerLadders() {
+    if (_buyLevels.offCenter() || _sellLevels.offCenter())
+      recenterLadders();
+  }
+  void recenterLadders();
+  bool submitCommand(CommandType type_, const Order &order_);
+  bool processCommands();
+  void processCommand(Command &command_);
+  void publishExecReport(const ExecReport &execReport_);
+  void beginStaging() { _staging = true; }
+  void publishStaged();
+  void endStaging() {
+    publishStaged();
+    _staging = false;
+  }
+  void processNewOrder(Order &order_);
+  void processCancelRequest(const Order &order_);
+  void updateLevel(Side side_, ticks_t ticks_, qty_t qty_);
+  // null for an ID outside the table
+  Trader *findTrader(int traderID_) {
+    return traderID_ >= 0 && static_cast<size_t>(traderID_) < _traders.size()
+               ? &_traders[traderID_]
+               : nullptr;
+  }
+  void registerTrader(int traderID_);
+  void updateOwnClock() {
+    if (_clock == &_ownClock)
+      _ownClock.update();
+  }
+  void acceptNewOrderRequest(Order *order_);
+  void rejectNewOrderRequest(Order &order_, const char *reason_);
+  void rejectCancelRequest(const Order &order_, const char *reason_);
+  Order::Ptr findRootOrder(int orderID_) const {
+    return _rootOrders.find(orderID_);
+  }
+  void addExecReport(const Order &order_, ExecType execType_,
+                     const char *text_ = ExecText::None);
+  void onAmendDown(Order *order_, qty_t newQty_);
+
+  void onTrade(Order *buyOrder_, Order *sellOrder_, ticks_t crossTicks_,
+               price_t crossPx_, qty_t crossQty_, bool auction_ = false);
+  void processUncross();
+  void executeAuction(const AuctionUncross &uncross_);
+  void removeOrder(Order *order_);
+  void retireOrder(Order *order_);
+  void onCancel(Order *order_);
+  void matchAggressor(Order *order_);
+  static bool canCross(const Order *buyOrder_, const Order *sellOrder_);
+  BookSide &getBookSide(Side side_);
+  const BookSide &getBookSide(Side side_) const;
+  ticks_t toTicks(price_t price_) const;
+  price_t toPrice(ticks_t ticks_) const;
   bool isTickAligned(price_t price_) const;
-  bool isValidPrice(price_t price_) const;
+  bool isValidPrice(ticks_t ticks_) const;
 
 public:
   price_t tickSize() const { return _tickSize; }
+  ticks_t ticksPerUnit() const { return _ticksPerUnit; }
   const std::string &symbol() const { return _symbol; }
   qty_t qtyAtLevel(Side side_, price_t price_) const;
   price_t bestAsk() const;
   price_t bestBid() const;
-  ExecReport::Ptr getExecMessage();
+  // exec reports are consumed by a single reader thread, which never
+  // contends with order entry or matching
+  std::optional<ExecReport> getExecMessage();
+  size_t getExecMessages(ExecReport *out_, size_t max_);
+  // level updates as the book changes, null when depthFeedMode is Off
+  DepthFeed *depthFeed() { return _depthFeed.get(); }
+  // resting order events, null when orderFeedCapacity is zero
+  OrderFeed *orderFeed() { return _orderFeed.get(); }
   qty_t tradedVolume() const { return _tradedVolume; }
 
+  // sizing information for the preallocated pools
+  const ObjectPool<Order> &orderPool() const { return _orderPool; }
+  const NodePool &farLevelNodes() const { return _farLevelNodes; }
+  const SpscRing<ExecReport> &execReports() const { return *_execReports; }
+  size_t droppedExecReports() const { return _droppedExecReports; }
+
+  // nanoseconds from onOrderSingle to the New report, and to the first fill
+  // of an order that trades on arrival
+  const LatencyHistogram &orderToAck() const { return _orderToAck; }
+  const LatencyHistogram &orderToFirstFill() const {
+    return _orderToFirstFill;
+  }
+
   void start();
   void stop();
 };
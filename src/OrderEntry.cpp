@@ -0,0 +1,41 @@
+#include "OrderEntry.h"
+
+#include <algorithm>
+#include <cmath>
+
+template <typename M> static M makeMessage(int traderID_,
+                                           std::string_view symbol_) {
+  M message{};
+  message.header.length = sizeof(M);
+  message.header.type = static_cast<uint8_t>(M::Type);
+  message.traderID = traderID_;
+  std::memcpy(message.symbol, symbol_.data(),
+              std::min(symbol_.size(), sizeof(message.symbol)));
+  return message;
+}
+
+void encodeNewOrder(char *out_, int traderID_, std::string_view symbol_,
+                    Side side_, qty_t qty_, price_t price_) {
+  auto message = makeMessage<NewOrderMessage>(traderID_, symbol_);
+  if (side_ != Side::Unknown)
+    message.side = static_cast<uint8_t>(side_ == Side::Buy ? WireSide::Buy
+                                                           : WireSide::Sell);
+  message.qty = qty_;
+  message.price = std::llround(price_ * PriceScale);
+  std::memcpy(out_, &message, sizeof(message));
+}
+
+void encodeCancelReplace(char *out_, int traderID_, std::string_view symbol_,
+                         int orderID_, qty_t qty_) {
+  auto message = makeMessage<CancelReplaceMessage>(traderID_, symbol_);
+  message.orderID = orderID_;
+  message.qty = qty_;
+  std::memcpy(out_, &message, sizeof(message));
+}
+
+void encodeCancel(char *out_, int traderID_, std::string_view symbol_,
+                  int orderID_) {
+  auto message = makeMessage<CancelMessage>(traderID_, symbol_);
+  message.orderID = orderID_;
+  std::memcpy(out_, &message, sizeof(message));
+}
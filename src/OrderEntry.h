@@ -0,0 +1,223 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+#include "Domain.h"
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "order entry messages are read in host byte order");
+
+// Binary order entry protocol. Every message is a fixed size little endian
+// struct starting with a MessageHeader whose length is the size of the whole
+// message. Symbols are NUL padded, prices are fixed point with PriceScale
+// units to 1.0, and a cancel replace may only amend the quantity down.
+enum class MessageType : uint8_t {
+  NewOrder = 'N',
+  CancelReplace = 'R',
+  Cancel = 'C',
+};
+
+enum class WireSide : uint8_t {
+  Buy = 1,
+  Sell = 2,
+};
+
+struct MessageHeader {
+  uint16_t length;
+  uint8_t type;
+  uint8_t reserved;
+};
+
+struct NewOrderMessage {
+  static constexpr MessageType Type = MessageType::NewOrder;
+  MessageHeader header;
+  int32_t traderID;
+  char symbol[8];
+  uint8_t side;
+  uint8_t reserved[7];
+  int64_t qty;
+  int64_t price;
+};
+
+struct CancelReplaceMessage {
+  static constexpr MessageType Type = MessageType::CancelReplace;
+  MessageHeader header;
+  int32_t traderID;
+  char symbol[8];
+  int32_t orderID;
+  uint32_t reserved;
+  int64_t qty;
+};
+
+struct CancelMessage {
+  static constexpr MessageType Type = MessageType::Cancel;
+  MessageHeader header;
+  int32_t traderID;
+  char symbol[8];
+  int32_t orderID;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(MessageHeader) == 4, "message header layout changed");
+static_assert(sizeof(NewOrderMessage) == 40, "new order layout changed");
+static_assert(sizeof(CancelReplaceMessage) == 32,
+              "cancel replace layout changed");
+static_assert(sizeof(CancelMessage) == 24, "cancel layout changed");
+
+static constexpr int64_t PriceScale = 100000000;
+
+// Reads the fields of a message of type M straight out of a receive buffer,
+// which need not be aligned. A view only holds a pointer, the buffer must
+// stay valid for as long as the view is used.
+template <typename M> class MessageView {
+  const char *_data;
+
+protected:
+  template <typename T> T load(size_t offset_) const {
+    T value;
+    std::memcpy(&value, _data + offset_, sizeof(T));
+    return value;
+  }
+
+public:
+  static constexpr size_t Size = sizeof(M);
+  explicit MessageView(const char *data_) : _data(data_) {}
+
+  const char *data() const { return _data; }
+  int traderID() const { return load<int32_t>(offsetof(M, traderID)); }
+  std::string_view symbol() const {
+    const char *symbol = _data + offsetof(M, symbol);
+    return std::string_view(symbol, strnlen(symbol, sizeof(M::symbol)));
+  }
+};
+
+class NewOrderView : public MessageView<NewOrderMessage> {
+public:
+  using MessageView::MessageView;
+  // Unknown for anything but WireSide values
+  Side side() const {
+    auto side = load<uint8_t>(offsetof(NewOrderMessage, side));
+    return side == static_cast<uint8_t>(WireSide::Buy)    ? Side::Buy
+           : side == static_cast<uint8_t>(WireSide::Sell) ? Side::Sell
+                                                          : Side::Unknown;
+  }
+  qty_t qty() const { return load<int64_t>(offsetof(NewOrderMessage, qty)); }
+  int64_t priceMantissa() const {
+    return load<int64_t>(offsetof(NewOrderMessage, price));
+  }
+  // the price in ticks of 1 / ticksPerUnit_, worked out in integers so no
+  // rounding can move it onto or off a tick. Empty unless it is on one.
+  std::optional<ticks_t> ticks(ticks_t ticksPerUnit_) const {
+    if (ticksPerUnit_ <= 0 || PriceScale % ticksPerUnit_ != 0)
+      return std::nullopt;
+    int64_t perTick = PriceScale / ticksPerUnit_;
+    if (priceMantissa() % perTick != 0)
+      return std::nullopt;
+    return priceMantissa() / perTick;
+  }
+};
+
+class CancelReplaceView : public MessageView<CancelReplaceMessage> {
+public:
+  using MessageView::MessageView;
+  int orderID() const {
+    return load<int32_t>(offsetof(CancelReplaceMessage, orderID));
+  }
+  qty_t qty() const {
+    return load<int64_t>(offsetof(CancelReplaceMessage, qty));
+  }
+};
+
+class CancelView : public MessageView<CancelMessage> {
+public:
+  using MessageView::MessageView;
+  int orderID() const {
+    return load<int32_t>(offsetof(CancelMessage, orderID));
+  }
+};
+
+// Splits a byte stream into messages and hands each to the handler as a
+// view, as handler_.onNewOrder(view), onCancelReplace(view) or
+// onCancel(view). Nothing is copied or allocated. A message whose length
+// does not match its type is a framing error: decoding stops there for good,
+// since the stream can no longer be trusted to line up with messages.
+class OrderEntryDecoder {
+  size_t _decoded;
+  bool _failed;
+
+  template <typename M>
+  bool checkLength(const MessageHeader &header_) {
+    if (header_.length == sizeof(M))
+      return true;
+    WARN("Bad order entry message length "
+         << LOG_NVP("Type", static_cast<char>(header_.type))
+         << LOG_NVP("Length", header_.length));
+    _failed = true;
+    return false;
+  }
+
+  // checked as soon as the header is in, a bad length must not leave the
+  // decoder waiting for a body that never comes
+  bool checkHeader(const MessageHeader &header_) {
+    switch (static_cast<MessageType>(header_.type)) {
+    case MessageType::NewOrder:
+      return checkLength<NewOrderMessage>(header_);
+    case MessageType::CancelReplace:
+      return checkLength<CancelReplaceMessage>(header_);
+    case MessageType::Cancel:
+      return checkLength<CancelMessage>(header_);
+    default:
+      WARN("Unknown order entry message "
+           << LOG_NVP("Type", static_cast<int>(header_.type)));
+      _failed = true;
+      return false;
+    }
+  }
+
+public:
+  OrderEntryDecoder() : _decoded(0), _failed(false) {}
+
+  // Returns the bytes consumed. A trailing partial message is left
+  // unconsumed, to be passed again once the rest of it has arrived.
+  template <typename Handler>
+  size_t decode(const char *data_, size_t size_, Handler &handler_) {
+    size_t offset(0);
+    while (not _failed && size_ - offset >= sizeof(MessageHeader)) {
+      MessageHeader header;
+      std::memcpy(&header, data_ + offset, sizeof(header));
+      if (not checkHeader(header) || size_ - offset < header.length)
+        break;
+      const char *message = data_ + offset;
+      switch (static_cast<MessageType>(header.type)) {
+      case MessageType::NewOrder:
+        handler_.onNewOrder(NewOrderView(message));
+        break;
+      case MessageType::CancelReplace:
+        handler_.onCancelReplace(CancelReplaceView(message));
+        break;
+      case MessageType::Cancel:
+        handler_.onCancel(CancelView(message));
+        break;
+      default:
+        break;
+      }
+      offset += header.length;
+      ++_decoded;
+    }
+    return offset;
+  }
+
+  size_t decoded() const { return _decoded; }
+  bool failed() const { return _failed; }
+};
+
+// encoders for clients and tests, each writes Size bytes to out_
+void encodeNewOrder(char *out_, int traderID_, std::string_view symbol_,
+                    Side side_, qty_t qty_, price_t price_);
+void encodeCancelReplace(char *out_, int traderID_, std::string_view symbol_,
+                         int orderID_, qty_t qty_);
+void encodeCancel(char *out_, int traderID_, std::string_view symbol_,
+                  int orderID_);
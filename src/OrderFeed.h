@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+#include "Domain.h"
+#include "SpscRing.h"
+
+// Add when an order starts resting, Modify when its resting quantity is
+// amended, Cancel when it is pulled and Execute for every fill against it.
+ENUM_MACRO_4(OrderEventType, Add, Modify, Cancel, Execute)
+
+// One market by order event, a fixed 40 bytes.
+struct OrderEvent {
+  // feed wide and gapless unless events were dropped
+  uint64_t sequence;
+  ticks_t ticks;
+  // Add: resting quantity, Modify: new resting quantity, Cancel: quantity
+  // removed, Execute: quantity filled
+  qty_t qty;
+  int32_t orderID;
+  // Execute only, the aggressing order
+  int32_t contraID;
+  OrderEventType type;
+  Side side;
+};
+
+static_assert(sizeof(OrderEvent) == 40, "order event layout changed");
+
+// Market by order stream for one book. Published from the book's writer
+// thread into an SpscRing; a full ring drops the event rather than wait, and
+// the consumer sees the hole in the sequence numbers.
+class OrderFeed {
+  SpscRing<OrderEvent> _events;
+  uint64_t _sequence;
+  std::atomic<size_t> _dropped;
+
+public:
+  explicit OrderFeed(size_t capacity_)
+      : _events(capacity_), _sequence(0), _dropped(0) {}
+  OrderFeed(const OrderFeed &) = delete;
+  OrderFeed &operator=(const OrderFeed &) = delete;
+
+  // writer side
+  void publish(OrderEventType type_, const Order &order_, qty_t qty_,
+               int contraID_ = 0) {
+    OrderEvent event;
+    event.sequence = ++_sequence;
+    event.ticks = order_.ticks();
+    event.qty = qty_;
+    event.orderID = order_.orderID();
+    event.contraID = contraID_;
+    event.type = type_;
+    event.side = order_.side();
+    if (not _events.tryPush(event))
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // consumer side, a single thread
+  size_t poll(OrderEvent *out_, size_t max_) {
+    return _events.popBatch(out_, max_);
+  }
+
+  size_t dropped() const { return _dropped; }
+};
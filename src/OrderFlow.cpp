@@ -0,0 +1,173 @@
+#include "OrderFlow.h"
+
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+
+static bool parseValue(std::string_view text_, long &out_) {
+  auto result =
+      std::from_chars(text_.data(), text_.data() + text_.size(), out_);
+  return result.ec == std::errc() && result.ptr == text_.data() + text_.size();
+}
+
+static bool parseValue(std::string_view text_, double &out_) {
+  auto result =
+      std::from_chars(text_.data(), text_.data() + text_.size(), out_);
+  return result.ec == std::errc() && result.ptr == text_.data() + text_.size();
+}
+
+static bool parseLine(std::string_view line_, FlowMessage &out_) {
+  auto next = [&line_]() {
+    while (not line_.empty() && line_.front() == ' ')
+      line_.remove_prefix(1);
+    auto token = line_.substr(0, line_.find(' '));
+    line_.remove_prefix(token.size());
+    return token;
+  };
+  auto type = next();
+  if (type == "NewOrder")
+    out_.type = CommandType::NewOrder;
+  else if (type == "CancelOrder")
+    out_.type = CommandType::CancelOrder;
+  else
+    return false;
+  Side side = Side::Unknown;
+  double price(0);
+  long qty(0), traderID(0), orderID(0);
+  for (auto token = next(); not token.empty(); token = next()) {
+    auto equals = token.find('=');
+    if (equals == std::string_view::npos)
+      return false;
+    auto key = token.substr(0, equals);
+    auto value = token.substr(equals + 1);
+    bool ok = true;
+    if (key == "Side")
+      side = str2enum<Side>(std::string(value).c_str());
+    else if (key == "Price")
+      ok = parseValue(value, price);
+    else if (key == "OrdQty")
+      ok = parseValue(value, qty);
+    else if (key == "TraderID")
+      ok = parseValue(value, traderID);
+    else if (key == "OrderID")
+      ok = parseValue(value, orderID);
+    if (not ok)
+      return false;
+  }
+  if (out_.type == CommandType::NewOrder && side == Side::Unknown)
+    return false;
+  out_.order = Order(side, qty, price);
+  out_.order.settraderID(static_cast<int>(traderID));
+  out_.order.setorderID(static_cast<int>(orderID));
+  return true;
+}
+
+static bool readTextFlow(const std::string &path_,
+                         std::vector<FlowMessage> &out_) {
+  std::ifstream file(path_);
+  std::string line;
+  for (size_t number(1); std::getline(file, line); number++) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    FlowMessage message;
+    if (not parseLine(line, message)) {
+      ERROR("Bad flow message " << LOG_NVP("Path", path_)
+                                << LOG_NVP("Line", number));
+      return false;
+    }
+    out_.push_back(message);
+  }
+  return true;
+}
+
+static bool readBinaryFlow(const std::string &path_,
+                           std::vector<FlowMessage> &out_) {
+  std::ifstream file(path_, std::ios::binary);
+  FlowFileHeader header;
+  if (not file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, FlowFileHeader::Magic, sizeof(header.magic))) {
+    ERROR("Not a binary flow file " << LOG_NVP("Path", path_));
+    return false;
+  }
+  FlowRecord record;
+  while (file.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+    if (record.type != static_cast<uint8_t>(CommandType::NewOrder) &&
+        record.type != static_cast<uint8_t>(CommandType::CancelOrder)) {
+      ERROR("Bad flow record " << LOG_NVP("Path", path_)
+                               << LOG_NVP("Record", out_.size()));
+      return false;
+    }
+    FlowMessage message;
+    message.type = static_cast<CommandType>(record.type);
+    message.order = Order(static_cast<Side>(record.side), record.qty,
+                          record.price);
+    message.order.settraderID(record.traderID);
+    message.order.setorderID(record.orderID);
+    out_.push_back(message);
+  }
+  if (file.gcount() != 0) {
+    ERROR("Truncated flow record " << LOG_NVP("Path", path_)
+                                   << LOG_NVP("Records", out_.size()));
+    return false;
+  }
+  return true;
+}
+
+bool readFlow(const std::string &path_, FlowFormat format_,
+              std::vector<FlowMessage> &out_) {
+  if (not std::ifstream(path_)) {
+    ERROR("Cannot open flow " << LOG_NVP("Path", path_));
+    return false;
+  }
+  return format_ == FlowFormat::Binary ? readBinaryFlow(path_, out_)
+                                       : readTextFlow(path_, out_);
+}
+
+bool writeBinaryFlow(const std::string &path_,
+                     const std::vector<FlowMessage> &messages_) {
+  std::ofstream file(path_, std::ios::binary | std::ios::trunc);
+  FlowFileHeader header;
+  std::memcpy(header.magic, FlowFileHeader::Magic, sizeof(header.magic));
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (auto &message : messages_) {
+    FlowRecord record{};
+    record.type = static_cast<uint8_t>(message.type);
+    record.side = static_cast<uint8_t>(message.order.side());
+    record.traderID = message.order.traderID();
+    record.orderID = message.order.orderID();
+    record.qty = message.order.ordQty();
+    record.price = message.order.price();
+    file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+  }
+  if (not file) {
+    ERROR("Failed to write flow " << LOG_NVP("Path", path_));
+    return false;
+  }
+  return true;
+}
+
+void FlowReplay::run(OrderBook &book_, double rate_) {
+  double nanosPerMessage = rate_ > 0 ? 1e9 / rate_ : 0;
+  cycles_t start = CycleClock::now();
+  for (size_t i(0); i < _flow.size(); i++) {
+    // a replay running behind schedule sends straight away, it does not
+    // skip messages to catch up
+    if (nanosPerMessage > 0) {
+      auto due = static_cast<uint64_t>(i * nanosPerMessage);
+      while (CycleClock::nanosSince(start) < due) {
+      }
+    }
+    Order order = _flow[i].order;
+    cycles_t sent = CycleClock::now();
+    if (_flow[i].type == CommandType::NewOrder) {
+      while (not book_.onOrderSingle(order))
+        _retries++;
+    } else {
+      while (not book_.onOrderCancelRequest(order))
+        _retries++;
+    }
+    _submitLatency.record(CycleClock::nanosSince(sent));
+  }
+  _elapsedNanos = CycleClock::nanosSince(start);
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Domain.h"
+#include "LatencyHistogram.h"
+#include "OrderBook.h"
+
+// A recorded order entry message, replayed through onOrderSingle or
+// onOrderCancelRequest.
+struct FlowMessage {
+  CommandType type = CommandType::Unknown;
+  Order order;
+};
+
+// Text flows hold one message per line in the test message syntax,
+//   NewOrder Side=Buy Price=50.1 OrdQty=100 TraderID=1
+//   CancelOrder OrderID=1 OrdQty=0 TraderID=1
+// where a cancel with a non zero OrdQty amends down. Blank lines and lines
+// starting with # are skipped. Binary flows are a FlowFileHeader followed by
+// fixed size FlowRecords.
+ENUM_MACRO_2(FlowFormat, Text, Binary)
+
+struct FlowFileHeader {
+  static constexpr char Magic[8] = {'O', 'B', 'F', 'L', 'O', 'W', '0', '1'};
+  char magic[8];
+};
+
+struct FlowRecord {
+  uint8_t type;
+  uint8_t side;
+  uint16_t reserved;
+  int32_t traderID;
+  int32_t orderID;
+  int32_t reserved2;
+  int64_t qty;
+  double price;
+};
+
+static_assert(sizeof(FlowRecord) == 32, "flow record layout changed");
+
+// both log what went wrong, with the line for text flows, and return false
+bool readFlow(const std::string &path_, FlowFormat format_,
+              std::vector<FlowMessage> &out_);
+bool writeBinaryFlow(const std::string &path_,
+                     const std::vector<FlowMessage> &messages_);
+
+// Feeds a loaded flow into a book from the calling thread, either as fast as
+// the book takes it or paced to a fixed message rate. In Async mode a full
+// command queue is retried rather than dropping the message. Exec reports
+// must be drained by another thread, typically an ExecWriter.
+class FlowReplay {
+  const std::vector<FlowMessage> &_flow;
+  LatencyHistogram _submitLatency;
+  size_t _retries;
+  uint64_t _elapsedNanos;
+
+public:
+  explicit FlowReplay(const std::vector<FlowMessage> &flow_)
+      : _flow(flow_), _submitLatency(), _retries(0), _elapsedNanos(0) {}
+
+  // rate_ in messages a second, zero for no pacing
+  void run(OrderBook &book_, double rate_ = 0);
+
+  size_t messages() const { return _flow.size(); }
+  uint64_t elapsedNanos() const { return _elapsedNanos; }
+  double throughput() const {
+    return _elapsedNanos ? _flow.size() * 1e9 / _elapsedNanos : 0;
+  }
+  // nanoseconds spent in onOrderSingle or onOrderCancelRequest
+  const LatencyHistogram &submitLatency() const { return _submitLatency; }
+  // Async submits refused by a full queue and tried again
+  size_t retries() const { return _retries; }
+};
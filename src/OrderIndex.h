@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "Domain.h"
+
+// Live orders by order ID, as a flat open addressed table. Order IDs are
+// handed out in sequence, so the low bits of an ID pick its slot directly and
+// consecutive orders land in consecutive slots. The full ID kept in the slot
+// is the generation check telling the live order apart from older and newer
+// ones sharing the slot. There are at least twice as many slots as orders the
+// book can hold, so a lookup is nearly always a single load.
+//
+// Once IDs lap a long resting order, every later order lands one slot past
+// its home and the run behind it grows with each insert. Entries are kept in
+// Robin Hood order, each run sorted by home slot, so that run costs nothing:
+// a lookup gives up at the first entry nearer its home than the probe is,
+// and erase shifts the rest of the run back only up to the first entry
+// already home. What a shift moves is what inserts displaced, so erase stays
+// constant time amortized, and there are no tombstones to slow lookups down.
+class OrderIndex {
+  struct Slot {
+    int orderID;
+    // null when the slot is free
+    Order *order;
+  };
+
+  std::unique_ptr<Slot[]> _slots;
+  size_t _mask;
+  size_t _size;
+
+  static size_t roundUp(size_t capacity_) {
+    size_t size(1);
+    while (size < capacity_)
+      size <<= 1;
+    return size;
+  }
+  size_t home(int orderID_) const {
+    return static_cast<size_t>(orderID_) & _mask;
+  }
+  // how far the entry in slot i_ sits past its home
+  size_t distance(size_t i_) const {
+    return (i_ - home(_slots[i_].orderID)) & _mask;
+  }
+  // the ID's slot, or the free slot or poorer entry where it would go
+  size_t locate(int orderID_) const {
+    size_t i = home(orderID_);
+    for (size_t probe(0);; i = (i + 1) & _mask, probe++) {
+      const Slot &slot = _slots[i];
+      if (!slot.order || slot.orderID == orderID_ || distance(i) < probe)
+        return i;
+    }
+  }
+
+public:
+  explicit OrderIndex(size_t maxOrders_)
+      : _slots(new Slot[roundUp(2 * maxOrders_ + 1)]()),
+        _mask(roundUp(2 * maxOrders_ + 1) - 1), _size(0) {}
+  OrderIndex(const OrderIndex &) = delete;
+  OrderIndex &operator=(const OrderIndex &) = delete;
+
+  Order *find(int orderID_) const {
+    const Slot &slot = _slots[locate(orderID_)];
+    return slot.order && slot.orderID == orderID_ ? slot.order : nullptr;
+  }
+
+  // the order's ID must not already be in the index, and the index may hold
+  // no more than maxOrders orders
+  void insert(Order *order_) {
+    Slot entry{order_->orderID(), order_};
+    size_t i = home(entry.orderID);
+    // take the place of any entry nearer its home, and carry that on instead
+    for (size_t probe(0); _slots[i].order; i = (i + 1) & _mask, probe++) {
+      size_t held = distance(i);
+      if (held < probe) {
+        std::swap(entry, _slots[i]);
+        probe = held;
+      }
+    }
+    _slots[i] = entry;
+    ++_size;
+  }
+
+  void erase(int orderID_) {
+    size_t i = locate(orderID_);
+    if (!_slots[i].order || _slots[i].orderID != orderID_)
+      return;
+    // pull the rest of the run back a slot, up to the first entry at home
+    for (size_t j = (i + 1) & _mask; _slots[j].order && distance(j) > 0;
+         j = (j + 1) & _mask) {
+      _slots[i] = _slots[j];
+      i = j;
+    }
+    _slots[i] = Slot{0, nullptr};
+    --_size;
+  }
+
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+};
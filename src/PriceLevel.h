@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+
+#include "Domain.h"
+
+// Resting orders at a single price, kept in time priority as an intrusive
+// doubly linked list threaded through the orders themselves.
+class PriceLevel {
+  Order *_head;
+  Order *_tail;
+  size_t _count;
+  qty_t _qty;
+
+public:
+  PriceLevel() : _head(nullptr), _tail(nullptr), _count(0), _qty(0) {}
+
+  Order *front() const { return _head; }
+  Order *back() const { return _tail; }
+  bool empty() const { return _head == nullptr; }
+  size_t count() const { return _count; }
+  qty_t qty() const { return _qty; }
+  void addQty(qty_t qty_) { _qty += qty_; }
+
+  void push(Order *order_) {
+    order_->_level = this;
+    order_->_prev = _tail;
+    order_->_next = nullptr;
+    if (_tail)
+      _tail->_next = order_;
+    else
+      _head = order_;
+    _tail = order_;
+    ++_count;
+  }
+
+  // takes over other_'s orders and totals when a level moves, leaving
+  // other_ empty
+  void takeFrom(PriceLevel &other_) {
+    *this = other_;
+    for (Order *order = _head; order; order = order->_next)
+      order->_level = this;
+    other_ = PriceLevel();
+  }
+
+  void erase(Order *order_) {
+    if (order_->_prev)
+      order_->_prev->_next = order_->_next;
+    else
+      _head = order_->_next;
+    if (order_->_next)
+      order_->_next->_prev = order_->_prev;
+    else
+      _tail = order_->_prev;
+    order_->_prev = nullptr;
+    order_->_next = nullptr;
+    order_->_level = nullptr;
+    --_count;
+  }
+};
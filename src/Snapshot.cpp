@@ -0,0 +1,151 @@
+#include "Snapshot.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unistd.h>
+
+#include "ExecJournal.h"
+
+bool BookSnapshot::save(const std::string &path_) const {
+  std::string temporary = path_ + ".tmp";
+  FILE *file = std::fopen(temporary.c_str(), "wb");
+  if (!file) {
+    ERROR("Failed to open snapshot " << LOG_VAR(temporary)
+                                     << LOG_NVP("Error", std::strerror(errno)));
+    return false;
+  }
+  bool ok =
+      std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+      std::fwrite(orders.data(), sizeof(SnapshotOrder), orders.size(), file) ==
+          orders.size() &&
+      std::fwrite(traders.data(), sizeof(int32_t), traders.size(), file) ==
+          traders.size() &&
+      std::fflush(file) == 0 && ::fsync(fileno(file)) == 0;
+  ok = std::fclose(file) == 0 && ok;
+  if (ok && std::rename(temporary.c_str(), path_.c_str()) == 0)
+    return true;
+  ERROR("Failed to write snapshot " << LOG_VAR(path_)
+                                    << LOG_NVP("Error", std::strerror(errno)));
+  std::remove(temporary.c_str());
+  return false;
+}
+
+bool BookSnapshot::load(const std::string &path_) {
+  std::ifstream file(path_, std::ios::binary);
+  if (not file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, SnapshotHeader::Magic, sizeof(header.magic)) ||
+      header.version != SnapshotHeader::Version ||
+      header.orderSize != sizeof(SnapshotOrder)) {
+    ERROR("Not a book snapshot " << LOG_VAR(path_));
+    return false;
+  }
+  orders.resize(header.orders);
+  traders.resize(header.traders);
+  if (not file.read(reinterpret_cast<char *>(orders.data()),
+                    orders.size() * sizeof(SnapshotOrder)) ||
+      not file.read(reinterpret_cast<char *>(traders.data()),
+                    traders.size() * sizeof(int32_t))) {
+    ERROR("Truncated book snapshot " << LOG_VAR(path_));
+    return false;
+  }
+  return true;
+}
+
+static bool replayJournal(OrderBook &book_, const std::string &path_) {
+  std::ifstream journal(path_, std::ios::binary);
+  JournalHeader header;
+  if (not journal.read(reinterpret_cast<char *>(&header), sizeof(header)))
+    // nothing journalled yet
+    return journal.gcount() == 0;
+  std::string symbol(header.symbol,
+                     strnlen(header.symbol, sizeof(header.symbol)));
+  if (not header.isValid() || symbol != book_.symbol() ||
+      header.ticksPerUnit != book_.ticksPerUnit()) {
+    ERROR("Journal does not belong to the book " << LOG_VAR(path_)
+                                                 << LOG_NVP("Symbol", symbol));
+    return false;
+  }
+  std::vector<ExecRecord> records(4096);
+  for (;;) {
+    journal.read(reinterpret_cast<char *>(records.data()),
+                 records.size() * sizeof(ExecRecord));
+    // a record torn by a crash mid write is dropped
+    size_t count = journal.gcount() / sizeof(ExecRecord);
+    for (size_t i(0); i < count; i++)
+      book_.replayReport(records[i].decode(header.ticksPerUnit));
+    if (count < records.size())
+      break;
+  }
+  book_.endReplay();
+  return true;
+}
+
+bool recoverBook(OrderBook &book_, const std::string &snapshotPath_,
+                 const std::string &journalPath_) {
+  auto start = std::chrono::steady_clock::now();
+  if (std::ifstream(snapshotPath_)) {
+    BookSnapshot snapshot;
+    if (not snapshot.load(snapshotPath_) || not book_.restore(snapshot))
+      return false;
+  }
+  int fromSequence = book_.sequence();
+  if (not replayJournal(book_, journalPath_))
+    return false;
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  INFO("Recovered book " << LOG_NVP("Symbol", book_.symbol())
+                         << LOG_NVP("Orders", book_.orderPool().size())
+                         << LOG_NVP("SnapshotSequence", fromSequence)
+                         << LOG_NVP("Sequence", book_.sequence())
+                         << LOG_NVP("Millis", elapsed.count()));
+  return true;
+}
+
+SnapshotWriter::SnapshotWriter(OrderBook::Ptr orderBook_,
+                               const SnapshotConfig &config_)
+    : _orderBookPtr(std::move(orderBook_)), _config(config_), _snapshot(),
+      _running(false), _thread(), _saved(0) {
+  if (_config.path.empty())
+    _config.path = "./" + _orderBookPtr->symbol() + ".snapshot";
+}
+
+SnapshotWriter::~SnapshotWriter() { stop(); }
+
+void SnapshotWriter::main() {
+  auto due = std::chrono::steady_clock::now() + _config.interval;
+  while (_running) {
+    if (std::chrono::steady_clock::now() < due) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      continue;
+    }
+    due += _config.interval;
+    size_t taken = _orderBookPtr->snapshotsTaken();
+    if (not _orderBookPtr->requestSnapshot(&_snapshot))
+      continue;
+    // an Inline book only takes it with its next request
+    while (_running && _orderBookPtr->snapshotsTaken() == taken)
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    if (_orderBookPtr->snapshotsTaken() == taken) {
+      if (_orderBookPtr->cancelSnapshot(&_snapshot))
+        break;
+      // taken just now, the copy is already under way
+      while (_orderBookPtr->snapshotsTaken() == taken)
+        std::this_thread::yield();
+    }
+    if (_snapshot.save(_config.path))
+      ++_saved;
+  }
+}
+
+void SnapshotWriter::start() {
+  _running = true;
+  _thread = std::thread(&SnapshotWriter::main, this);
+}
+
+void SnapshotWriter::stop() {
+  _running = false;
+  if (_thread.joinable())
+    _thread.join();
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "OrderBook.h"
+
+// Leads a book snapshot file, followed by `orders` SnapshotOrders and
+// `traders` trader IDs.
+struct SnapshotHeader {
+  static constexpr char Magic[8] = {'O', 'B', 'S', 'N', 'A', 'P', 'S', '1'};
+  static constexpr uint32_t Version = 1;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t orderSize;
+  char symbol[16];
+  int64_t ticksPerUnit;
+  int64_t closeTicks;
+  // exec ID of the last report reflected in the snapshot, journal replay
+  // carries on from the one after
+  uint64_t sequence;
+  int64_t tradedVolume;
+  int32_t oidSeed;
+  // TradingPhase
+  uint32_t phase;
+  uint64_t orders;
+  uint64_t traders;
+};
+
+// a resting order, snapshots hold them level by level in time priority
+struct SnapshotOrder {
+  int64_t ticks;
+  int64_t ordQty;
+  int64_t cumQty;
+  int64_t lastTicks;
+  int64_t lastQty;
+  int32_t orderID;
+  int32_t traderID;
+  uint8_t side;
+  uint8_t status;
+  uint8_t reserved[6];
+};
+
+static_assert(sizeof(SnapshotHeader) == 88, "snapshot header layout changed");
+static_assert(sizeof(SnapshotOrder) == 56, "snapshot order layout changed");
+
+// Full state of one book at a request boundary. Captured by the book's
+// writer, which only copies into vectors kept from the previous capture, and
+// saved to disk by whoever asked for it.
+struct BookSnapshot {
+  SnapshotHeader header{};
+  std::vector<SnapshotOrder> orders;
+  std::vector<int32_t> traders;
+
+  // written to a temporary file and renamed over path_, so a crash never
+  // leaves a half written snapshot behind
+  bool save(const std::string &path_) const;
+  bool load(const std::string &path_);
+};
+
+// Brings a book that has not been started back to where it was: restores
+// the snapshot when there is one, then replays every report in the binary
+// exec journal after the snapshot's sequence. Either file may be missing.
+// Returns false if a file exists but does not belong to this book.
+bool recoverBook(OrderBook &book_, const std::string &snapshotPath_,
+                 const std::string &journalPath_);
+
+struct SnapshotConfig {
+  std::string path;
+  std::chrono::milliseconds interval{std::chrono::seconds(10)};
+};
+
+// Periodically asks a running book for a snapshot and saves it on its own
+// thread, so matching only pauses for the in memory copy.
+class SnapshotWriter {
+  OrderBook::Ptr _orderBookPtr;
+  SnapshotConfig _config;
+  BookSnapshot _snapshot;
+  std::atomic<bool> _running;
+  std::thread _thread;
+  std::atomic<size_t> _saved;
+
+  void main();
+
+public:
+  SnapshotWriter(OrderBook::Ptr orderBook_, const SnapshotConfig &config_);
+  ~SnapshotWriter();
+  void start();
+  void stop();
+
+  size_t saved() const { return _saved; }
+};
@@ -0,0 +1,103 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Bounded lock free ring for exactly one producer and one consumer thread.
+// Producer and consumer indices live on their own cache lines, and each side
+// keeps a cached copy of the other's index so the shared line is only read
+// when the ring looks full (producer) or empty (consumer).
+template <typename T> class SpscRing {
+  static constexpr size_t CacheLine = 64;
+
+  struct alignas(CacheLine) Producer {
+    std::atomic<size_t> tail{0};
+    size_t cachedHead{0};
+    size_t highWater{0};
+  };
+  struct alignas(CacheLine) Consumer {
+    std::atomic<size_t> head{0};
+    size_t cachedTail{0};
+  };
+
+  Producer _producer;
+  Consumer _consumer;
+  size_t _capacity;
+  size_t _mask;
+  std::unique_ptr<T[]> _slots;
+
+  static size_t roundUp(size_t capacity_) {
+    size_t size(1);
+    while (size < capacity_)
+      size <<= 1;
+    return size;
+  }
+
+public:
+  // capacity is rounded up to a power of two
+  explicit SpscRing(size_t capacity_)
+      : _producer(), _consumer(), _capacity(roundUp(capacity_)),
+        _mask(_capacity - 1), _slots(new T[_capacity]) {}
+  SpscRing(const SpscRing &) = delete;
+  SpscRing &operator=(const SpscRing &) = delete;
+
+  // producer side
+  bool tryPush(const T &value_) {
+    size_t tail = _producer.tail.load(std::memory_order_relaxed);
+    if (tail - _producer.cachedHead == _capacity) {
+      _producer.cachedHead = _consumer.head.load(std::memory_order_acquire);
+      if (tail - _producer.cachedHead == _capacity)
+        return false;
+    }
+    _slots[tail & _mask] = value_;
+    _producer.tail.store(tail + 1, std::memory_order_release);
+    _producer.highWater =
+        std::max(_producer.highWater, tail + 1 - _producer.cachedHead);
+    return true;
+  }
+
+  // producer side, publishes the first elements of values_ that fit with a
+  // single release of the tail. Returns how many were pushed.
+  size_t pushBatch(const T *values_, size_t count_) {
+    size_t tail = _producer.tail.load(std::memory_order_relaxed);
+    if (_capacity - (tail - _producer.cachedHead) < count_)
+      _producer.cachedHead = _consumer.head.load(std::memory_order_acquire);
+    size_t count =
+        std::min(count_, _capacity - (tail - _producer.cachedHead));
+    for (size_t i(0); i < count; i++)
+      _slots[(tail + i) & _mask] = values_[i];
+    if (count) {
+      _producer.tail.store(tail + count, std::memory_order_release);
+      _producer.highWater =
+          std::max(_producer.highWater, tail + count - _producer.cachedHead);
+    }
+    return count;
+  }
+
+  // consumer side
+  bool tryPop(T &value_) { return popBatch(&value_, 1) == 1; }
+
+  // pops up to max_ elements into out_, returns how many were popped
+  size_t popBatch(T *out_, size_t max_) {
+    size_t head = _consumer.head.load(std::memory_order_relaxed);
+    if (_consumer.cachedTail - head < max_)
+      _consumer.cachedTail = _producer.tail.load(std::memory_order_acquire);
+    size_t count = std::min(_consumer.cachedTail - head, max_);
+    for (size_t i(0); i < count; i++)
+      out_[i] = _slots[(head + i) & _mask];
+    if (count)
+      _consumer.head.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  size_t capacity() const { return _capacity; }
+  // approximate when called concurrently with the producer or consumer
+  size_t size() const {
+    size_t head = _consumer.head.load(std::memory_order_acquire);
+    return _producer.tail.load(std::memory_order_acquire) - head;
+  }
+  bool empty() const { return size() == 0; }
+  // most elements the producer has seen queued at once
+  size_t highWater() const { return _producer.highWater; }
+};
@@ -3,126 +3,140 @@
 #include <ctime>
 #include <iomanip>
 #include <iostream>
+#include <string>
+#include <string_view>
 
-#define __FILENAME__                                                           \
-  (__builtin_strrchr(__FILE__, '/') ? __builtin_strrchr(__FILE__, '/') + 1     \
-                                    : __FILE__)
-#define INFO(msg_)                                                             \
-  std::cout << " INFO    " << msg_ << " |" << __FILENAME__ << ":" << __LINE__  \
-            << '\n'
-#define WARN(msg_)                                                             \
-  std::cout << " WARN    " << msg_ << " |" << __FILENAME__ << ":" << __LINE__  \
-            << '\n'
-#define ERROR(msg_)                                                            \
-  std::cout << " ERROR   " << msg_ << " |" << __FILENAME__ << ":" << __LINE__  \
-            << '\n'
+#include "Logger.h"
 
 #define LOG_VAR(var_) #var_ << "='" << var_ << "', "
 #define LOG_NVP(name_, var_) name_ << "=" << var_ << " "
 
 #define ENUM_MACRO_5(name, v1, v2, v3, v4, v5)                                 \
   enum class name { v1, v2, v3, v4, v5, Unknown };                             \
+  inline std::string_view enum2sv(name value) {                                \
+    static constexpr std::string_view name##Strings[] = {                      \
+        #v1, #v2, #v3, #v4, #v5, "Unknown"};                                   \
+    return name##Strings[(int)value];                                          \
+  }                                                                            \
   inline std::string enum2str(name value) {                                    \
-    const char *name##Strings[] = {#v1, #v2, #v3, #v4, #v5, "Unknown"};        \
-    return std::string(name##Strings[(int)value]);                             \
+    return std::string(enum2sv(value));                                        \
   }                                                                            \
   inline std::ostream &operator<<(std::ostream &stream_, name val_) {          \
-    return stream_ << enum2str(val_);                                          \
+    return stream_ << enum2sv(val_);                                           \
   }                                                                            \
   template <> inline name str2enum(const char *value) {                        \
-    return (enum2str(name::v1) == value)   ? name::v1                          \
-           : (enum2str(name::v2) == value) ? name::v2                          \
-           : (enum2str(name::v3) == value) ? name::v3                          \
-           : (enum2str(name::v4) == value) ? name::v4                          \
-           : (enum2str(name::v5) == value) ? name::v5                          \
-                                           : name::Unknown;                    \
+    return (enum2sv(name::v1) == value)   ? name::v1                           \
+           : (enum2sv(name::v2) == value) ? name::v2                           \
+           : (enum2sv(name::v3) == value) ? name::v3                           \
+           : (enum2sv(name::v4) == value) ? name::v4                           \
+           : (enum2sv(name::v5) == value) ? name::v5                           \
+                                          : name::Unknown;                     \
   }
 
 #define ENUM_MACRO_4(name, v1, v2, v3, v4)                                     \
   enum class name { v1, v2, v3, v4, Unknown };                                 \
+  inline std::string_view enum2sv(name value) {                                \
+    static constexpr std::string_view name##Strings[] = {                      \
+        #v1, #v2, #v3, #v4, "Unknown"};                                        \
+    return name##Strings[(int)value];                                          \
+  }                                                                            \
   inline std::string enum2str(name value) {                                    \
-    const char *name##Strings[] = {#v1, #v2, #v3, #v4, "Unknown"};             \
-    return std::string(name##Strings[(int)value]);                             \
+    return std::string(enum2sv(value));                                        \
   }                                                                            \
   inline std::ostream &operator<<(std::ostream &stream_, name val_) {          \
-    return stream_ << enum2str(val_);                                          \
+    return stream_ << enum2sv(val_);                                           \
   }                                                                            \
   template <> inline name str2enum(const char *value) {                        \
-    return (enum2str(name::v1) == value)   ? name::v1                          \
-           : (enum2str(name::v2) == value) ? name::v2                          \
-           : (enum2str(name::v3) == value) ? name::v3                          \
-           : (enum2str(name::v4) == value) ? name::v4                          \
-                                           : name::Unknown;                    \
+    return (enum2sv(name::v1) == value)   ? name::v1                           \
+           : (enum2sv(name::v2) == value) ? name::v2                           \
+           : (enum2sv(name::v3) == value) ? name::v3                           \
+           : (enum2sv(name::v4) == value) ? name::v4                           \
+                                          : name::Unknown;                     \
   }
 
 #define ENUM_MACRO_2(name, v1, v2)                                             \
   enum class name { v1, v2, Unknown };                                         \
+  inline std::string_view enum2sv(name value) {                                \
+    static constexpr std::string_view name##Strings[] = {                      \
+        #v1, #v2, "Unknown"};                                                  \
+    return name##Strings[(int)value];                                          \
+  }                                                                            \
   inline std::string enum2str(name value) {                                    \
-    const char *name##Strings[] = {#v1, #v2, "Unknown"};                       \
-    return std::string(name##Strings[(int)value]);                             \
+    return std::string(enum2sv(value));                                        \
   }                                                                            \
   inline std::ostream &operator<<(std::ostream &stream_, name val_) {          \
-    return stream_ << enum2str(val_);                                          \
+    return stream_ << enum2sv(val_);                                           \
   }                                                                            \
   template <> inline name str2enum(const char *value) {                        \
-    return (enum2str(name::v1) == value)   ? name::v1                          \
-           : (enum2str(name::v2) == value) ? name::v2                          \
-                                           : name::Unknown;                    \
+    return (enum2sv(name::v1) == value)   ? name::v1                           \
+           : (enum2sv(name::v2) == value) ? name::v2                           \
+                                          : name::Unknown;                     \
   }
 
 #define ENUM_MACRO_3(name, v1, v2, v3)                                         \
   enum class name { v1, v2, v3, Unknown };                                     \
+  inline std::string_view enum2sv(name value) {                                \
+    static constexpr std::string_view name##Strings[] = {                      \
+        #v1, #v2, #v3, "Unknown"};                                             \
+    return name##Strings[(int)value];                                          \
+  }                                                                            \
   inline std::string enum2str(name value) {                                    \
-    const char *name##Strings[] = {#v1, #v2, #v3, "Unknown"};                  \
-    return std::string(name##Strings[(int)value]);                             \
+    return std::string(enum2sv(value));                                        \
   }                                                                            \
   inline std::ostream &operator<<(std::ostream &stream_, name val_) {          \
-    return stream_ << enum2str(val_);                                          \
+    return stream_ << enum2sv(val_);                                           \
   }                                                                            \
   template <> inline name str2enum(const char *value) {                        \
-    return (enum2str(name::v1) == value)   ? name::v1                          \
-           : (enum2str(name::v2) == value) ? name::v2                          \
-           : (enum2str(name::v3) == value) ? name::v3                          \
-                                           : name::Unknown;                    \
+    return (enum2sv(name::v1) == value)   ? name::v1                           \
+           : (enum2sv(name::v2) == value) ? name::v2                           \
+           : (enum2sv(name::v3) == value) ? name::v3                           \
+                                          : name::Unknown;                     \
   }
 
 #define ENUM_MACRO_6(name, v1, v2, v3, v4, v5, v6)                             \
   enum class name { v1, v2, v3, v4, v5, v6, Unknown };                         \
+  inline std::string_view enum2sv(name value) {                                \
+    static constexpr std::string_view name##Strings[] = {                      \
+        #v1, #v2, #v3, #v4, #v5, #v6, "Unknown"};                              \
+    return name##Strings[(int)value];                                          \
+  }                                                                            \
   inline std::string enum2str(name value) {                                    \
-    const char *name##Strings[] = {#v1, #v2, #v3, #v4, #v5, #v6, "Unknown"};   \
-    return std::string(name##Strings[(int)value]);                             \
+    return std::string(enum2sv(value));                                        \
   }                                                                            \
   inline std::ostream &operator<<(std::ostream &stream_, name val_) {          \
-    return stream_ << enum2str(val_);                                          \
+    return stream_ << enum2sv(val_);                                           \
   }                                                                            \
   template <> inline name str2enum(const char *value) {                        \
-    return (enum2str(name::v1) == value)   ? name::v1                          \
-           : (enum2str(name::v2) == value) ? name::v2                          \
-           : (enum2str(name::v3) == value) ? name::v3                          \
-           : (enum2str(name::v4) == value) ? name::v4                          \
-           : (enum2str(name::v5) == value) ? name::v5                          \
-           : (enum2str(name::v6) == value) ? name::v6                          \
-                                           : name::Unknown;                    \
+    return (enum2sv(name::v1) == value)   ? name::v1                           \
+           : (enum2sv(name::v2) == value) ? name::v2                           \
+           : (enum2sv(name::v3) == value) ? name::v3                           \
+           : (enum2sv(name::v4) == value) ? name::v4                           \
+           : (enum2sv(name::v5) == value) ? name::v5                           \
+           : (enum2sv(name::v6) == value) ? name::v6                           \
+                                          : name::Unknown;                     \
   }
 #define ENUM_MACRO_7(name, v1, v2, v3, v4, v5, v6, v7)                         \
   enum class name { v1, v2, v3, v4, v5, v6, v7, Unknown };                     \
+  inline std::string_view enum2sv(name value) {                                \
+    static constexpr std::string_view name##Strings[] = {                      \
+        #v1, #v2, #v3, #v4, #v5, #v6, #v7, "Unknown"};                         \
+    return name##Strings[(int)value];                                          \
+  }                                                                            \
   inline std::string enum2str(name value) {                                    \
-    const char *name##Strings[] = {#v1, #v2, #v3, #v4,                         \
-                                   #v5, #v6, #v7, "Unknown"};                  \
-    return std::string(name##Strings[(int)value]);                             \
+    return std::string(enum2sv(value));                                        \
   }                                                                            \
   inline std::ostream &operator<<(std::ostream &stream_, name val_) {          \
-    return stream_ << enum2str(val_);                                          \
+    return stream_ << enum2sv(val_);                                           \
   }                                                                            \
   template <> inline name str2enum(const char *value) {                        \
-    return (enum2str(name::v1) == value)   ? name::v1                          \
-           : (enum2str(name::v2) == value) ? name::v2                          \
-           : (enum2str(name::v3) == value) ? name::v3                          \
-           : (enum2str(name::v4) == value) ? name::v4                          \
-           : (enum2str(name::v5) == value) ? name::v5                          \
-           : (enum2str(name::v6) == value) ? name::v6                          \
-           : (enum2str(name::v7) == value) ? name::v7                          \
-                                           : name::Unknown;                    \
+    return (enum2sv(name::v1) == value)   ? name::v1                           \
+           : (enum2sv(name::v2) == value) ? name::v2                           \
+           : (enum2sv(name::v3) == value) ? name::v3                           \
+           : (enum2sv(name::v4) == value) ? name::v4                           \
+           : (enum2sv(name::v5) == value) ? name::v5                           \
+           : (enum2sv(name::v6) == value) ? name::v6                           \
+           : (enum2sv(name::v7) == value) ? name::v7                           \
+                                          : name::Unknown;                     \
   }
 template <typename T> inline const char *enum2str(T) { return ""; }
 template <typename T> inline T str2enum(const char *value) {
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Utils.h"
+
+// how an idle consumer waits for producers to signal more work
+ENUM_MACRO_3(WaitStrategy, Spin, SpinYield, Block)
+
+// Wakes a single consumer thread when producers publish work. The consumer
+// takes a ticket before checking for work and then waits on that ticket, so
+// a notify landing in between is never missed.
+class WorkSignal {
+  std::atomic<uint32_t> _sequence;
+  std::atomic<uint32_t> _sleepers;
+  WaitStrategy _strategy;
+
+  static constexpr int SpinCount = 1024;
+
+  static void pause() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+
+  long futex(int op_, uint32_t value_) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(&_sequence), op_,
+                   value_, nullptr, nullptr, 0);
+  }
+
+public:
+  explicit WorkSignal(WaitStrategy strategy_)
+      : _sequence(0), _sleepers(0), _strategy(strategy_) {}
+
+  WaitStrategy strategy() const { return _strategy; }
+
+  uint32_t ticket() const { return _sequence.load(std::memory_order_acquire); }
+
+  void notify() {
+    _sequence.fetch_add(1, std::memory_order_seq_cst);
+    if (_sleepers.load(std::memory_order_seq_cst) != 0)
+      futex(FUTEX_WAKE_PRIVATE, 1);
+  }
+
+  // returns once notify() has been called since ticket_ was taken
+  void wait(uint32_t ticket_) {
+    for (int i(0); ticket() == ticket_; i++) {
+      if (_strategy == WaitStrategy::Spin || i < SpinCount) {
+        pause();
+      } else if (_strategy == WaitStrategy::SpinYield) {
+        std::this_thread::yield();
+      } else {
+        _sleepers.fetch_add(1, std::memory_order_seq_cst);
+        // the kernel rechecks the sequence so a racing notify is not lost
+        futex(FUTEX_WAIT_PRIVATE, ticket_);
+        _sleepers.fetch_sub(1, std::memory_order_seq_cst);
+      }
+    }
+  }
+};
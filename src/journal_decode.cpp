@@ -0,0 +1,37 @@
+#include <fstream>
+#include <iostream>
+
+#include "ExecJournal.h"
+#include "ExecWriter.h"
+
+// Prints a binary exec journal in the text journal format.
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    std::cerr << "usage: " << argv[0] << " <binary journal>\n";
+    return 1;
+  }
+  std::ifstream journal(argv[1], std::ios::binary);
+  if (not journal) {
+    std::cerr << "cannot open " << argv[1] << '\n';
+    return 1;
+  }
+  JournalHeader header;
+  if (not journal.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      not header.isValid()) {
+    std::cerr << argv[1] << " is not a binary exec journal\n";
+    return 1;
+  }
+  LineFormatter line;
+  ExecRecord record;
+  size_t records(0);
+  while (journal.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+    ExecWriter::formatText(line, record.decode(header.ticksPerUnit));
+    std::cout.write(line.data(), line.size());
+    ++records;
+  }
+  if (journal.gcount() != 0) {
+    std::cerr << "truncated record after " << records << " records\n";
+    return 1;
+  }
+  return 0;
+}
@@ -1,9 +1,14 @@
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <unordered_map>
 
 #include "ExecWriter.h"
+#include "LatencyHistogram.h"
 #include "OrderBook.h"
+#include "OrderFlow.h"
+#include "Snapshot.h"
 
 void print_screen(const OrderBook::Ptr &orderBook) {
   system("clear");
@@ -15,20 +20,117 @@ void print_screen(const OrderBook::Ptr &orderBook) {
             << ask << "]\n";
 }
 
-int main() {
+static void print_latency(const char *name_, const LatencyHistogram &hist_) {
+  std::cout << name_ << ": count=" << hist_.count() << " mean=" << hist_.mean()
+            << " p50=" << hist_.percentile(0.5)
+            << " p99=" << hist_.percentile(0.99)
+            << " p99.9=" << hist_.percentile(0.999) << " max=" << hist_.max()
+            << " ns\n";
+}
 
-  auto orderBook = std::make_shared<OrderBook>("XYZ", 50.32);
+static int usage() {
+  std::cerr << "usage: book\n"
+               "       book --replay FILE [--binary] [--rate MSGS_PER_SEC] "
+               "[--async]\n"
+               "            [--symbol SYMBOL] [--close PRICE]\n";
+  return 1;
+}
+
+// Replays a recorded flow through a fresh book and reports throughput and
+// latency. Orders and cancels refer to order IDs as the book assigns them,
+// so the flow must be replayed against the same symbol and close price it
+// was recorded with.
+static int replay(int argc, char **argv) {
+  std::string path, symbol("XYZ");
+  price_t close(50.32);
+  double rate(0);
+  FlowFormat format = FlowFormat::Text;
+  BookConfig config;
+  for (int i(1); i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (not std::strcmp(argv[i], "--replay") && hasValue)
+      path = argv[++i];
+    else if (not std::strcmp(argv[i], "--binary"))
+      format = FlowFormat::Binary;
+    else if (not std::strcmp(argv[i], "--rate") && hasValue)
+      rate = std::atof(argv[++i]);
+    else if (not std::strcmp(argv[i], "--async"))
+      config.matchingMode = MatchingMode::Async;
+    else if (not std::strcmp(argv[i], "--symbol") && hasValue)
+      symbol = argv[++i];
+    else if (not std::strcmp(argv[i], "--close") && hasValue)
+      close = std::atof(argv[++i]);
+    else
+      return usage();
+  }
+  std::vector<FlowMessage> flow;
+  if (path.empty() || not readFlow(path, format, flow))
+    return usage();
+  config.maxOrders = std::max(config.maxOrders, flow.size());
+
+  auto orderBook = std::make_shared<OrderBook>(symbol, close, config);
   auto execWriter = std::make_shared<ExecWriter>(orderBook);
+  FlowReplay replay(flow);
+  orderBook->start();
+  execWriter->start();
+  replay.run(*orderBook, rate);
+  // stopping the book finishes queued Async requests, stopping the writer
+  // journals every report they produced
+  orderBook->stop();
+  execWriter->stop();
 
-  std::unordered_map<int, std::unordered_map<int, Order::Ptr>> orders_;
+  std::cout << "Replayed " << replay.messages() << " messages in "
+            << replay.elapsedNanos() / 1e6 << " ms, "
+            << static_cast<uint64_t>(replay.throughput()) << " msgs/s";
+  if (replay.retries())
+    std::cout << ", " << replay.retries() << " queue full retries";
+  std::cout << '\n';
+  print_latency("Submit", replay.submitLatency());
+  print_latency("OrderToAck", orderBook->orderToAck());
+  print_latency("OrderToFirstFill", orderBook->orderToFirstFill());
+  print_latency("ReportToJournal", execWriter->reportToJournal());
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1)
+    return replay(argc, argv);
+
+  auto orderBook = std::make_shared<OrderBook>("XYZ", 50.32);
+  // the binary journal and periodic snapshots bring the book back on restart
+  JournalConfig journalConfig;
+  journalConfig.path = "./XYZ_exec_journal.bin";
+  journalConfig.format = JournalFormat::Binary;
+  SnapshotConfig snapshotConfig;
+  snapshotConfig.path = "./XYZ.snapshot";
+  if (not recoverBook(*orderBook, snapshotConfig.path, journalConfig.path)) {
+    std::cerr << "Failed to recover the book, see the log\n";
+    return 1;
+  }
+  auto execWriter = std::make_shared<ExecWriter>(orderBook, journalConfig);
+  SnapshotWriter snapshotWriter(orderBook, snapshotConfig);
+
+  std::unordered_map<int, std::unordered_map<int, Order>> orders_;
+
+  LatencyDump latency(std::chrono::minutes(1));
+  latency.add("OrderToAck", orderBook->orderToAck());
+  latency.add("OrderToFirstFill", orderBook->orderToFirstFill());
+  latency.add("ReportToJournal", execWriter->reportToJournal());
 
   orderBook->start();
   execWriter->start();
+  snapshotWriter.start();
+  latency.start();
 
   bool stop = false;
   print_screen(orderBook);
 
   while (not stop) {
+    // nothing more is accepted once reports may be missing from the journal
+    if (execWriter->failures()) {
+      std::cerr << "The exec journal is failing, see the log\n";
+      break;
+    }
     char request;
     int traderID;
     std::cout << "Enter TraderID: ";
@@ -56,9 +158,10 @@ int main() {
       std::cout << "Qty: ";
       std::cin >> qty;
       print_screen(orderBook);
-      auto newOrder = std::make_shared<Order>(side, qty, price);
+      Order newOrder(side, qty, price);
+      newOrder.settraderID(traderID);
       orderBook->onOrderSingle(newOrder);
-      orders_[traderID].emplace(std::pair(newOrder->orderID(), newOrder));
+      orders_[traderID].emplace(std::pair(newOrder.orderID(), newOrder));
       break;
     }
     case ('M'): {
@@ -80,10 +183,9 @@ int main() {
       int qty;
       std::cin >> qty;
       print_screen(orderBook);
-      auto modifiedOrder = std::make_shared<Order>(order->second->side(),
-                                                   order->second->ordQty(),
-                                                   order->second->price());
-      modifiedOrder->setorderID(order->second->orderID());
+      Order modifiedOrder(order->second.side(), qty, order->second.price());
+      modifiedOrder.setorderID(order->second.orderID());
+      modifiedOrder.settraderID(traderID);
       orderBook->onOrderCancelRequest(modifiedOrder);
       break;
     }
@@ -96,5 +198,13 @@ int main() {
     }
     }
   }
+  snapshotWriter.stop();
   orderBook->stop();
+  execWriter->stop();
+  // the book is stopped, so this thread may take the final snapshot itself
+  BookSnapshot snapshot;
+  orderBook->captureSnapshot(snapshot);
+  snapshot.save(snapshotConfig.path);
+  latency.stop();
+  latency.dump();
 }
@@ -3,6 +3,7 @@
 
 #include <map>
 #include <memory>
+#include <optional>
 #include <sstream>
 #include <utility>
 
@@ -41,29 +42,29 @@ public:
 };
 
 struct EnvMessage {
-  Order::Ptr order;
-  ExecReport::Ptr execReport;
+  std::optional<Order> order;
+  std::optional<ExecReport> execReport;
 
   explicit EnvMessage(Params params_) {
     double price = std::stod(params_.at("Price"));
     int qty = std::stoi(params_.at("OrdQty"));
     Side side = str2enum<Side>(params_.at("Side").c_str());
-    auto temporder = std::make_shared<Order>(side, qty, price);
+    Order temporder(side, qty, price);
     if (params_["Type"] == "NewOrder") {
       int traderID = std::stoi(params_.at("TraderID"));
-      temporder->settraderID(traderID);
+      temporder.settraderID(traderID);
       order = temporder;
     } else if (params_["Type"] == "CancelOrder") {
       int traderID = std::stoi(params_.at("TraderID"));
       int oid = std::stoi(params_.at("OrderID"));
-      temporder->settraderID(traderID);
-      temporder->setorderID(oid);
+      temporder.settraderID(traderID);
+      temporder.setorderID(oid);
       order = temporder;
     } else if (params_["Type"] == "ExecReport") {
       int oid = std::stoi(params_.at("OrderID"));
-      temporder->setorderID(oid);
+      temporder.setorderID(oid);
       auto execType = str2enum<ExecType>(params_.at("ExecType").c_str());
-      execReport = std::make_shared<ExecReport>(temporder, execType);
+      execReport = ExecReport(temporder, execType);
     } else {
       throw std::runtime_error("Unknown Type of test message " +
                                params_["Type"]);
@@ -74,8 +75,10 @@ struct EnvMessage {
 class TestEnv {
 
 public:
-  explicit TestEnv(const std::string &symbol_, double closePrice_)
-      : _orderBook(std::make_shared<OrderBook>(symbol_, closePrice_)) {
+  explicit TestEnv(const std::string &symbol_, double closePrice_,
+                   const BookConfig &config_ = BookConfig())
+      : _orderBook(
+            std::make_shared<OrderBook>(symbol_, closePrice_, config_)) {
     _orderBook->start();
   }
   ~TestEnv() { _orderBook->stop(); }
@@ -85,6 +88,17 @@ public:
 private:
   OrderBook::Ptr _orderBook;
 
+  // async books publish from the engine thread, so allow them time to catch up
+  std::optional<ExecReport> nextExecMessage() {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    auto message = _orderBook->getExecMessage();
+    while (!message && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::yield();
+      message = _orderBook->getExecMessage();
+    }
+    return message;
+  }
+
   static void messageFrom(const std::string &msgStr_, Params &params_) {
     Params params(msgStr_);
     std::string chunk;
@@ -120,9 +134,9 @@ public:
     messageFrom(str_, params);
     auto message = EnvMessage(params);
     if (params["Type"] == "NewOrder")
-      _orderBook->onOrderSingle(message.order);
+      _orderBook->onOrderSingle(*message.order);
     else if (params["Type"] == "CancelOrder")
-      _orderBook->onOrderCancelRequest(message.order);
+      _orderBook->onOrderCancelRequest(*message.order);
     return message;
   }
 
@@ -131,7 +145,7 @@ public:
     std::this_thread::sleep_for(std::chrono::microseconds(10));
     if (str_.find("NONE") != std::string::npos) {
       auto message = _orderBook->getExecMessage();
-      if (message != nullptr) {
+      if (message) {
         FAIL() << str_
                << " Unmatched event: " << LOG_NVP("OrderID", message->orderID())
                << LOG_NVP("Text", message->text())
@@ -149,7 +163,7 @@ public:
     Params params(str_);
     messageFrom(str_, params);
 
-    ExecReport::Ptr execReport = _orderBook->getExecMessage();
+    auto execReport = nextExecMessage();
     if (!execReport) {
       FAIL() << "Unmatched filter: " << str_;
     }
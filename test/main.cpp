@@ -1,5 +1,19 @@
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <random>
+#include <set>
 #include <gtest/gtest.h>
 
+#include "BookBuilder.h"
+#include "ExecWriter.h"
+#include "LineFormatter.h"
+#include "MatchingEngine.h"
+#include "OrderFlow.h"
+#include "Snapshot.h"
+
 #include "fwk/TestEnv.cpp"
 
 TEST(OrderBook, smoke_test) {
@@ -66,7 +80,11 @@ TEST(OrderBook, multiple_levels_close_price_greater_than_10) {
 }
 
 TEST(OrderBook, trader_cannot_exceed_100_messages_per_second) {
-  TestEnv env("XYZ", 50.32);
+  // the clock never moves, so the bucket gets no refill during the burst
+  CoarseClock clock;
+  BookConfig config;
+  config.clock = &clock;
+  TestEnv env("XYZ", 50.32, config);
   for (int i(0); i < 100;) {
     env << "NewOrder Price=50.0 OrdQty=100 Side=Buy TraderID=1" LN;
     env >> ("ExecReport ExecType=New OrdStatus=New Price=50.0 Side=Buy "
@@ -131,6 +149,1366 @@ TEST(OrderBook, alcova_example) {
   env >> "NONE" LN;
 }
 
+TEST(OrderBook, cancel_removes_order_from_level) {
+  TestEnv env("XYZ", 50.32);
+  env << "NewOrder Price=50.0 OrdQty=100 Side=Buy TraderID=1" LN;
+  env >> "ExecReport ExecType=New OrdStatus=New Price=50.0 Side=Buy OrdQty=100 "
+         "LastQty=0 CumQty=0 LastPrice=0 OrderID=1" LN;
+  env << "NewOrder Price=50.1 OrdQty=50 Side=Buy TraderID=2" LN;
+  env >> "ExecReport ExecType=New OrdStatus=New Price=50.1 Side=Buy OrdQty=50 "
+         "LastQty=0 CumQty=0 LastPrice=0 OrderID=2" LN;
+  ASSERT_EQ(env.orderBook()->bestBid(), 50.1);
+  env << "CancelOrder OrdQty=0 OrderID=2 Price=50.1 Side=Buy TraderID=2" LN;
+  env >> "ExecReport ExecType=Cancel OrdStatus=Cancelled Price=50.1 OrdQty=50 "
+         "LastQty=0 CumQty=0 OrderID=2" LN;
+  ASSERT_EQ(env.orderBook()->qtyAtLevel(Side::Buy, 50.1), 0);
+  ASSERT_EQ(env.orderBook()->bestBid(), 50.0);
+  env << "CancelOrder OrdQty=0 OrderID=2 Price=50.1 Side=Buy TraderID=2" LN;
+  env >> "ExecReport ExecType=CancelReject OrdStatus=PendingNew Price=50.1 "
+         "OrdQty=0 LastQty=0 CumQty=0 OrderID=2 Text=Order_not_found." LN;
+  env >> "NONE" LN;
+}
+
+TEST(OrderBook, orders_at_same_level_fill_in_time_priority) {
+  TestEnv env("XYZ", 50.32);
+  env << "NewOrder Price=50.0 OrdQty=50 Side=Buy TraderID=1" LN;
+  env >> "ExecReport ExecType=New OrdStatus=New Price=50.0 Side=Buy OrdQty=50 "
+         "LastQty=0 CumQty=0 LastPrice=0 OrderID=1" LN;
+  env << "NewOrder Price=50.0 OrdQty=50 Side=Buy TraderID=2" LN;
+  env >> "ExecReport ExecType=New OrdStatus=New Price=50.0 Side=Buy OrdQty=50 "
+         "LastQty=0 CumQty=0 LastPrice=0 OrderID=2" LN;
+  env << "NewOrder Price=50.0 OrdQty=60 Side=Sell TraderID=3" LN;
+  env >> "ExecReport ExecType=New OrdStatus=New Price=50.0 Side=Sell OrdQty=60 "
+         "LastQty=0 CumQty=0 LastPrice=0 OrderID=3" LN;
+  env >> "ExecReport ExecType=Trade OrdStatus=PartiallyFilled Price=50.0 "
+         "OrdQty=60 LastQty=50 CumQty=50 OrderID=3" LN;
+  env >> "ExecReport ExecType=Trade OrdStatus=Filled Price=50.0 OrdQty=50 "
+         "LastQty=50 CumQty=50 OrderID=1" LN;
+  env >> "ExecReport ExecType=Trade OrdStatus=Filled Price=50.0 OrdQty=60 "
+         "LastQty=10 CumQty=60 OrderID=3" LN;
+  env >> "ExecReport ExecType=Trade OrdStatus=PartiallyFilled Price=50.0 "
+         "OrdQty=50 LastQty=10 CumQty=10 OrderID=2" LN;
+  ASSERT_EQ(env.orderBook()->qtyAtLevel(Side::Buy, 50.0), 40);
+  env >> "NONE" LN;
+}
+
+TEST(OrderBook, prices_must_be_tick_aligned_and_within_band) {
+  TestEnv env("XYZ", 50.32);
+  env << "NewOrder Price=50.325 OrdQty=100 Side=Buy TraderID=1" LN;
+  env >> "ExecReport OrdStatus=Rejected ExecType=Reject OrderID=1 OrdQty=100 "
+         "Side=Buy LastQty=0 CumQty=0 LastPrice=0 Price=50.325 "
+         "Text=Order_price_is_not_multiple_of_ticksize" LN;
+  env << "NewOrder Price=60.33 OrdQty=100 Side=Sell TraderID=1" LN;
+  env >> "ExecReport OrdStatus=Rejected ExecType=Reject OrderID=2 OrdQty=100 "
+         "Side=Sell LastQty=0 CumQty=0 LastPrice=0 Price=60.33 "
+         "Text=Order_price_is_outside_threshold_of_closePrice" LN;
+  env << "NewOrder Price=60.32 OrdQty=100 Side=Sell TraderID=1" LN;
+  env >> "ExecReport ExecType=New OrdStatus=New Price=60.32 Side=Sell "
+         "OrdQty=100 LastQty=0 CumQty=0 LastPrice=0 OrderID=3" LN;
+  env << "NewOrder Price=40.32 OrdQty=100 Side=Buy TraderID=1" LN;
+  env >> "ExecReport ExecType=New OrdStatus=New Price=40.32 Side=Buy "
+         "OrdQty=100 LastQty=0 CumQty=0 LastPrice=0 OrderID=4" LN;
+  ASSERT_EQ(env.orderBook()->qtyAtLevel(Side::Sell, 60.32), 100);
+  ASSERT_EQ(env.orderBook()->bestAsk(), 60.32);
+  ASSERT_EQ(env.orderBook()->bestBid(), 40.32);
+  env >> "NONE" LN;
+}
+
+TEST(OrderBook, filled_and_cancelled_orders_return_to_pool) {
+  TestEnv env("XYZ", 50.32);
+  env << "NewOrder Price=50.0 OrdQty=100 Side=Buy TraderID=1" LN;
+  env >> "ExecReport ExecType=New OrdStatus=New Price=50.0 Side=Buy OrdQty=100 "
+         "LastQty=0 CumQty=0 LastPrice=0 OrderID=1" LN;
+  env << "NewOrder Price=49.0 OrdQty=50 Side=Buy TraderID=1" LN;
+  env >> "ExecReport ExecType=New OrdStatus=New Price=49.0 Side=Buy OrdQty=50 "
+         "LastQty=0 CumQty=0 LastPrice=0 OrderID=2" LN;
+  env << "NewOrder Price=50.0 OrdQty=100 Side=Sell TraderID=2" LN;
+  env >> "ExecReport ExecType=New OrdStatus=New Price=50.0 Side=Sell "
+         "OrdQty=100 LastQty=0 CumQty=0 LastPrice=0 OrderID=3" LN;
+  env >> "ExecReport ExecType=Trade OrdStatus=Filled Price=50.0 OrdQty=100 "
+         "LastQty=100 CumQty=100 OrderID=3" LN;
+  env >> "ExecReport ExecType=Trade OrdStatus=Filled Price=50.0 OrdQty=100 "
+         "LastQty=100 CumQty=100 OrderID=1" LN;
+  ASSERT_EQ(env.orderBook()->orderPool().size(), 1);
+  env << "CancelOrder OrdQty=0 OrderID=2 Price=49.0 Side=Buy TraderID=1" LN;
+  env >> "ExecReport ExecType=Cancel OrdStatus=Cancelled Price=49.0 OrdQty=50 "
+         "LastQty=0 CumQty=0 OrderID=2" LN;
+  ASSERT_EQ(env.orderBook()->orderPool().size(), 0);
+  ASSERT_EQ(env.orderBook()->orderPool().highWater(), 3);
+  ASSERT_EQ(env.orderBook()->execReports().size(), 0);
+}
+
+TEST(OrderBook, order_rejected_when_pool_is_full) {
+  BookConfig config;
+  config.maxOrders = 1;
+  TestEnv env("XYZ", 50.32, config);
+  env << "NewOrder Price=50.0 OrdQty=100 Side=Buy TraderID=1" LN;
+  env >> "ExecReport ExecType=New OrdStatus=New Price=50.0 Side=Buy OrdQty=100 "
+         "LastQty=0 CumQty=0 LastPrice=0 OrderID=1" LN;
+  env << "NewOrder Price=49.0 OrdQty=50 Side=Buy TraderID=1" LN;
+  env >> "ExecReport OrdStatus=Rejected ExecType=Reject OrderID=2 OrdQty=50 "
+         "Side=Buy LastQty=0 CumQty=0 LastPrice=0 Price=49.0 "
+         "Text=Order_capacity_exceeded" LN;
+  env << "CancelOrder OrdQty=0 OrderID=1 Price=50.0 Side=Buy TraderID=1" LN;
+  env >> "ExecReport ExecType=Cancel OrdStatus=Cancelled Price=50.0 "
+         "OrdQty=100 LastQty=0 CumQty=0 OrderID=1" LN;
+  env << "NewOrder Price=49.0 OrdQty=50 Side=Buy TraderID=1" LN;
+  env >> "ExecReport ExecType=New OrdStatus=New Price=49.0 Side=Buy OrdQty=50 "
+         "LastQty=0 CumQty=0 LastPrice=0 OrderID=3" LN;
+  env >> "NONE" LN;
+}
+
+TEST(OrderBook, exec_reports_drain_in_batches_and_count_drops) {
+  BookConfig config;
+  config.maxExecReports = 4;
+  config.overflowPolicy = OverflowPolicy::Drop;
+  OrderBook book("XYZ", 50.32, config);
+  for (int i(0); i < 6; i++) {
+    Order order(Side::Buy, 100, 50.0 - i);
+    order.settraderID(1);
+    book.onOrderSingle(order);
+  }
+  ASSERT_EQ(book.droppedExecReports(), 2);
+  ExecReport reports[8];
+  ASSERT_EQ(book.getExecMessages(reports, 8), 4);
+  for (int i(0); i < 4; i++) {
+    ASSERT_EQ(reports[i].orderID(), i + 1);
+    ASSERT_EQ(reports[i].execType(), ExecType::New);
+  }
+  ASSERT_EQ(book.execReports().highWater(), 4);
+  ASSERT_FALSE(book.getExecMessage());
+}
+
+TEST(OrderBook, token_bucket_limits_each_trader) {
+  BookConfig config;
+  config.rateLimit.messagesPerSecond = 10;
+  config.rateLimit.burst = 3;
+  config.maxTraders = 16;
+  OrderBook book("XYZ", 50.32, config);
+  auto send = [&book](int traderID_) {
+    Order order(Side::Buy, 10, 50.0);
+    order.settraderID(traderID_);
+    book.onOrderSingle(order);
+    return *book.getExecMessage();
+  };
+  for (int i(0); i < 3; i++)
+    ASSERT_EQ(send(1).execType(), ExecType::New);
+  auto limited = send(1);
+  ASSERT_EQ(limited.execType(), ExecType::Reject);
+  ASSERT_STREQ(limited.text(), ExecText::RateExceeded);
+  // each trader has a bucket of its own
+  ASSERT_EQ(send(2).execType(), ExecType::New);
+  ASSERT_STREQ(send(16).text(), ExecText::TraderOutOfRange);
+
+  Order cancel(Side::Buy, 0, 0);
+  cancel.setorderID(1);
+  cancel.settraderID(3);
+  book.onOrderCancelRequest(cancel);
+  ASSERT_STREQ(book.getExecMessage()->text(), ExecText::TraderNotRegistered);
+  cancel.settraderID(1);
+  book.onOrderCancelRequest(cancel);
+  ASSERT_STREQ(book.getExecMessage()->text(), ExecText::RateExceeded);
+  ASSERT_EQ(book.qtyAtLevel(Side::Buy, 50.0), 40);
+
+  // a tenth of a second buys at least one more token
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  book.onOrderCancelRequest(cancel);
+  ASSERT_EQ(book.getExecMessage()->execType(), ExecType::Cancel);
+  ASSERT_EQ(book.qtyAtLevel(Side::Buy, 50.0), 30);
+}
+
+TEST(OrderBook, async_mode_accepts_orders_from_many_threads) {
+  BookConfig config;
+  config.matchingMode = MatchingMode::Async;
+  OrderBook book("XYZ", 50.32, config);
+  book.start();
+  const int threads = 4;
+  const int perThread = 500;
+  std::vector<std::thread> clients;
+  for (int t(0); t < threads; t++) {
+    clients.emplace_back([&book, t] {
+      for (int i(0); i < perThread; i++) {
+        Order order(Side::Buy, 10, 45.0 + t);
+        order.settraderID(t * perThread + i);
+        while (not book.onOrderSingle(order))
+          std::this_thread::yield();
+      }
+    });
+  }
+  for (auto &client : clients)
+    client.join();
+  book.stop();
+
+  std::vector<bool> seen(threads * perThread + 1, false);
+  ExecReport report;
+  int count(0);
+  while (book.getExecMessages(&report, 1)) {
+    ASSERT_EQ(report.execType(), ExecType::New);
+    ASSERT_FALSE(seen.at(report.orderID()));
+    seen[report.orderID()] = true;
+    count++;
+  }
+  ASSERT_EQ(count, threads * perThread);
+  for (int t(0); t < threads; t++)
+    ASSERT_EQ(book.qtyAtLevel(Side::Buy, 45.0 + t), 10 * perThread);
+}
+
+TEST(MatchingEngine, routes_orders_to_the_shard_owning_the_symbol) {
+  EngineConfig config;
+  config.shards = 2;
+  config.cores = {0, 0};
+  std::vector<Listing> listings{{"AAA", 10.0}, {"BBB", 20.0}, {"CCC", 30.0}};
+  MatchingEngine engine(listings, config);
+  ASSERT_EQ(engine.shardOf("AAA"), 0);
+  ASSERT_EQ(engine.shardOf("BBB"), 1);
+  ASSERT_EQ(engine.shardOf("CCC"), 0);
+  ASSERT_EQ(engine.shardOf("ZZZ"), MatchingEngine::npos);
+  Order unknown(Side::Buy, 10, 1.0);
+  unknown.setsymbol("ZZZ");
+  ASSERT_FALSE(engine.onOrderSingle(unknown));
+
+  engine.start();
+  std::vector<std::thread> clients;
+  for (auto listing : listings) {
+    clients.emplace_back([&engine, listing] {
+      for (int i(0); i < 50; i++) {
+        Order order(i % 2 ? Side::Sell : Side::Buy, 10, listing.closePrice);
+        order.setsymbol(listing.symbol);
+        order.settraderID(i % 2);
+        ASSERT_TRUE(engine.onOrderSingle(order));
+      }
+    });
+  }
+  for (auto &client : clients)
+    client.join();
+  engine.stop();
+
+  std::map<std::string, int> trades;
+  ExecReport reports[64];
+  for (size_t shard(0); shard < engine.shardCount(); shard++) {
+    size_t count;
+    while ((count = engine.getExecMessages(shard, reports, 64)) > 0) {
+      for (size_t i(0); i < count; i++) {
+        auto &symbol = engine.symbolOf(reports[i].bookID());
+        ASSERT_EQ(engine.shardOf(symbol), shard);
+        if (reports[i].execType() == ExecType::Trade)
+          ++trades[symbol];
+      }
+    }
+  }
+  for (auto &listing : listings) {
+    // 25 crosses, two reports each
+    ASSERT_EQ(trades[listing.symbol], 50) << listing.symbol;
+    ASSERT_EQ(engine.book(listing.symbol)->tradedVolume(), 250);
+  }
+}
+
+TEST(MatchingEngine, decodes_binary_order_entry_in_place) {
+  std::vector<Listing> listings{{"AAA", 10.0}, {"BBB", 20.0}};
+  MatchingEngine engine(listings);
+  char stream[256];
+  size_t size(0);
+  encodeNewOrder(stream + size, 1, "AAA", Side::Buy, 100, 10.01);
+  size += NewOrderView::Size;
+  encodeNewOrder(stream + size, 2, "BBB", Side::Sell, 30, 19.99);
+  size += NewOrderView::Size;
+  encodeCancelReplace(stream + size, 1, "AAA", 1, 60);
+  size += CancelReplaceView::Size;
+  encodeNewOrder(stream + size, 3, "AAA", Side::Sell, 10, 10.01);
+  size += NewOrderView::Size;
+  encodeCancel(stream + size, 2, "BBB", 1);
+  size += CancelView::Size;
+
+  NewOrderView view(stream);
+  ASSERT_EQ(view.traderID(), 1);
+  ASSERT_EQ(view.symbol(), "AAA");
+  ASSERT_EQ(view.side(), Side::Buy);
+  ASSERT_EQ(view.qty(), 100);
+  ASSERT_EQ(view.priceMantissa(), 1001000000);
+  ASSERT_EQ(view.ticks(100), 1001);
+  ASSERT_EQ(view.ticks(1000), 10010);
+  ASSERT_FALSE(view.ticks(10));
+
+  engine.start();
+  OrderEntryDecoder decoder;
+  // the second new order arrives split across two reads
+  size_t split = NewOrderView::Size + 10;
+  size_t consumed = decoder.decode(stream, split, engine);
+  ASSERT_EQ(consumed, NewOrderView::Size);
+  consumed += decoder.decode(stream + consumed, size - consumed, engine);
+  ASSERT_EQ(consumed, size);
+  ASSERT_EQ(decoder.decoded(), 5);
+  ASSERT_FALSE(decoder.failed());
+  engine.stop();
+
+  ASSERT_EQ(engine.book("AAA")->tradedVolume(), 10);
+  ASSERT_EQ(engine.book("AAA")->qtyAtLevel(Side::Buy, 10.01), 50);
+  ASSERT_EQ(engine.book("BBB")->qtyAtLevel(Side::Sell, 19.99), 0);
+
+  // a length that does not match the type stops the stream for good
+  stream[0] = 1;
+  OrderEntryDecoder broken;
+  ASSERT_EQ(broken.decode(stream, size, engine), 0);
+  ASSERT_TRUE(broken.failed());
+  ASSERT_EQ(broken.decode(stream + NewOrderView::Size, 8, engine), 0);
+
+  // and is caught from the header alone, without waiting for the body
+  MessageHeader header{0xffff, static_cast<uint8_t>(MessageType::Cancel), 0};
+  OrderEntryDecoder oversized;
+  ASSERT_EQ(oversized.decode(reinterpret_cast<const char *>(&header),
+                             sizeof(header), engine),
+            0);
+  ASSERT_TRUE(oversized.failed());
+}
+
+TEST(MatchingEngine, order_to_ack_includes_time_queued_for_the_shard) {
+  std::vector<Listing> listings{{"AAA", 10.0}};
+  MatchingEngine engine(listings);
+  char message[NewOrderView::Size];
+  encodeNewOrder(message, 1, "AAA", Side::Buy, 10, 10.0);
+  ASSERT_TRUE(engine.onNewOrder(NewOrderView(message)));
+  Order order(Side::Sell, 10, 10.0);
+  order.setsymbol("AAA");
+  order.settraderID(2);
+  ASSERT_TRUE(engine.onOrderSingle(order));
+  // both wait in the queue until the shard starts
+  const auto queued = std::chrono::milliseconds(20);
+  std::this_thread::sleep_for(queued);
+  engine.start();
+  engine.stop();
+  const OrderBook *book = engine.book("AAA");
+  ASSERT_EQ(book->orderToAck().count(), 2);
+  ASSERT_GE(book->orderToAck().mean(),
+            std::chrono::nanoseconds(queued).count());
+  ASSERT_EQ(book->orderToFirstFill().count(), 1);
+  ASSERT_GE(book->orderToFirstFill().max(),
+            std::chrono::nanoseconds(queued).count());
+  // and from a stamp, not from zero
+  ASSERT_LT(book->orderToAck().max(),
+            std::chrono::nanoseconds(std::chrono::seconds(10)).count());
+}
+
+TEST(MatchingEngine, rejects_bad_quantities_and_off_tick_prices) {
+  std::vector<Listing> listings{{"AAA", 10.0}};
+  MatchingEngine engine(listings);
+  char stream[256];
+  size_t size(0);
+  encodeNewOrder(stream + size, 1, "AAA", Side::Buy, 10, 10.01);
+  size += NewOrderView::Size;
+  encodeNewOrder(stream + size, 2, "AAA", Side::Sell, -5, 10.01);
+  size += NewOrderView::Size;
+  encodeNewOrder(stream + size, 2, "AAA", Side::Sell, 0, 10.01);
+  size += NewOrderView::Size;
+  // a hundred millionth off the tick, never reaches the book
+  encodeNewOrder(stream + size, 2, "AAA", Side::Sell, 5, 10.01000001);
+  ASSERT_FALSE(NewOrderView(stream + size).ticks(100));
+  size += NewOrderView::Size;
+  encodeCancelReplace(stream + size, 1, "AAA", 1, -5);
+  size += CancelReplaceView::Size;
+
+  engine.start();
+  OrderEntryDecoder decoder;
+  ASSERT_EQ(decoder.decode(stream, size, engine), size);
+  ASSERT_EQ(decoder.decoded(), 5);
+  engine.stop();
+
+  ExecReport reports[8];
+  ASSERT_EQ(engine.getExecMessages(0, reports, 8), 4);
+  ASSERT_EQ(reports[0].execType(), ExecType::New);
+  for (int i : {1, 2}) {
+    ASSERT_EQ(reports[i].execType(), ExecType::Reject);
+    ASSERT_STREQ(reports[i].text(), ExecText::QtyNotPositive);
+  }
+  ASSERT_EQ(reports[3].execType(), ExecType::CancelReject);
+  ASSERT_STREQ(reports[3].text(), ExecText::QtyNotPositive);
+  const OrderBook *book = engine.book("AAA");
+  ASSERT_EQ(book->tradedVolume(), 0);
+  ASSERT_EQ(book->qtyAtLevel(Side::Buy, 10.01), 10);
+  ASSERT_EQ(book->qtyAtLevel(Side::Sell, 10.01), 0);
+}
+
+TEST(OrderIndex, finds_live_orders_like_a_map) {
+  // small enough that long lived orders share slots with newer IDs
+  const size_t maxOrders = 64;
+  OrderIndex index(maxOrders);
+  std::map<int, Order *> live;
+  std::vector<Order> orders(5000);
+  std::mt19937 random(3);
+  for (int id(1); id < static_cast<int>(orders.size()); id++) {
+    if (live.size() == maxOrders) {
+      auto victim = live.begin();
+      std::advance(victim, random() % live.size());
+      index.erase(victim->first);
+      live.erase(victim);
+    }
+    orders[id].setorderID(id);
+    index.insert(&orders[id]);
+    live[id] = &orders[id];
+    ASSERT_EQ(index.size(), live.size());
+    for (int probe(std::max(1, id - 300)); probe <= id; probe++) {
+      auto it = live.find(probe);
+      ASSERT_EQ(index.find(probe), it == live.end() ? nullptr : it->second)
+          << probe;
+    }
+  }
+  ASSERT_EQ(index.find(static_cast<int>(orders.size())), nullptr);
+}
+
+TEST(OrderIndex, erases_locally_after_lapping_a_resting_order) {
+  const size_t maxOrders = 64;
+  OrderIndex index(maxOrders);
+  std::vector<Order> orders(5000);
+  // rests while the IDs lap it many times over, pushing each order with its
+  // home slot one past it
+  orders[1].setorderID(1);
+  index.insert(&orders[1]);
+  std::mt19937 random(5);
+  std::deque<int> live;
+  for (int id(2); id < static_cast<int>(orders.size()); id++) {
+    if (live.size() == maxOrders - 1) {
+      // mostly the oldest, sometimes one from the middle of the run
+      size_t victim = random() % 4 ? 0 : random() % live.size();
+      index.erase(live[victim]);
+      ASSERT_EQ(index.find(live[victim]), nullptr);
+      live.erase(live.begin() + victim);
+    }
+    orders[id].setorderID(id);
+    index.insert(&orders[id]);
+    live.push_back(id);
+    ASSERT_EQ(index.size(), live.size() + 1);
+    ASSERT_EQ(index.find(1), &orders[1]) << id;
+    for (int probe : live)
+      ASSERT_EQ(index.find(probe), &orders[probe]) << probe;
+    ASSERT_EQ(index.find(id + 1), nullptr);
+  }
+  index.erase(1);
+  ASSERT_EQ(index.find(1), nullptr);
+  for (int probe : live)
+    ASSERT_EQ(index.find(probe), &orders[probe]) << probe;
+  for (int probe : live)
+    index.erase(probe);
+  ASSERT_TRUE(index.empty());
+}
+
+TEST(LevelBitmap, finds_nearest_occupied_level_like_a_scan) {
+  // three layers deep
+  const size_t size = 70000;
+  LevelBitmap bitmap(size);
+  std::set<size_t> occupied;
+  std::mt19937 random(7);
+  for (int i(0); i < 20000; i++) {
+    size_t index = random() % size;
+    if (random() % 3) {
+      bitmap.set(index);
+      occupied.insert(index);
+    } else {
+      bitmap.clear(index);
+      occupied.erase(index);
+    }
+    size_t probe = random() % size;
+    auto above = occupied.upper_bound(probe);
+    ASSERT_EQ(bitmap.nextAbove(probe),
+              above == occupied.end() ? LevelBitmap::npos : *above);
+    auto below = occupied.lower_bound(probe);
+    ASSERT_EQ(bitmap.nextBelow(probe), below == occupied.begin()
+                                           ? LevelBitmap::npos
+                                           : *std::prev(below));
+    ASSERT_EQ(bitmap.test(index), occupied.count(index) == 1);
+  }
+}
+
+TEST(BookSide, finds_levels_like_a_map_as_the_window_slides) {
+  std::vector<Order> orders(4000);
+  NodePool farNodes(BookSide::FarNodeSize, orders.size());
+  BookSide side(Side::Buy, 64, 1000, farNodes);
+  ASSERT_EQ(side.windowSize(), 64);
+  std::map<ticks_t, size_t> levels;
+  std::vector<size_t> resting;
+  std::mt19937 random(11);
+  // the touch wanders, with now and then an order far from it
+  ticks_t touch(1000);
+  for (size_t i(0); i < orders.size(); i++) {
+    if (not resting.empty() && random() % 3 == 0) {
+      size_t pick = random() % resting.size();
+      Order &order = orders[resting[pick]];
+      side.remove(&order);
+      if (--levels[order.ticks()] == 0)
+        levels.erase(order.ticks());
+      resting[pick] = resting.back();
+      resting.pop_back();
+    } else {
+      touch = std::max<ticks_t>(100, touch + random() % 21 - 10);
+      ticks_t ticks = random() % 10 == 0 ? touch - random() % 2000
+                                          : touch - random() % 40;
+      orders[i].setticks(std::max<ticks_t>(0, ticks));
+      side.add(&orders[i]);
+      ++levels[orders[i].ticks()];
+      resting.push_back(i);
+    }
+    if (side.offCenter()) {
+      std::vector<std::pair<ticks_t, bool>> moved;
+      side.recenter([&moved](ticks_t ticks_, const PriceLevel &level_,
+                             bool inWindow_) {
+        ASSERT_FALSE(level_.empty());
+        moved.emplace_back(ticks_, inWindow_);
+      });
+      ASSERT_FALSE(side.offCenter());
+      for (auto [ticks, inWindow] : moved)
+        ASSERT_EQ(side.inWindow(ticks), inWindow);
+    }
+    ASSERT_EQ(side.bestTicks(),
+              levels.empty() ? BookSide::npos : levels.rbegin()->first);
+    size_t far(0);
+    for (auto [ticks, count] : levels) {
+      far += not side.inWindow(ticks);
+      ASSERT_EQ(side.level(ticks)->count(), count) << ticks;
+    }
+    ASSERT_EQ(side.farLevels(), far);
+    // every far level's node came from the pool
+    ASSERT_EQ(farNodes.size(), far);
+    ASSERT_EQ(farNodes.heapAllocations(), 0);
+    for (int probe(0); probe < 8; probe++) {
+      ticks_t ticks = std::max<ticks_t>(0, touch + 50 - random() % 2200);
+      auto above = levels.upper_bound(ticks);
+      auto below = levels.lower_bound(ticks);
+      ASSERT_EQ(side.nextAbove(ticks),
+                above == levels.end() ? BookSide::npos : above->first);
+      ASSERT_EQ(side.nextBelow(ticks), below == levels.begin()
+                                           ? BookSide::npos
+                                           : std::prev(below)->first);
+    }
+  }
+  for (size_t i : resting)
+    ASSERT_EQ(orders[i].level(), side.level(orders[i].ticks()));
+}
+
+TEST(LatencyHistogram, percentiles_stay_within_a_sixteenth) {
+  LatencyHistogram histogram;
+  for (uint64_t value(1); value <= 100000; value++)
+    histogram.record(value);
+  ASSERT_EQ(histogram.count(), 100000);
+  ASSERT_EQ(histogram.max(), 100000);
+  ASSERT_DOUBLE_EQ(histogram.mean(), 50000.5);
+  for (double fraction : {0.5, 0.9, 0.99, 0.999}) {
+    double exact = fraction * 100000;
+    auto reported = static_cast<double>(histogram.percentile(fraction));
+    ASSERT_GE(reported, exact) << fraction;
+    ASSERT_LE(reported, exact * (1 + 1.0 / 16)) << fraction;
+  }
+  ASSERT_EQ(histogram.percentile(1.0), 100000);
+}
+
+TEST(OrderBook, records_order_to_ack_and_first_fill_latency) {
+  TestEnv env("XYZ", 1.0);
+  env << "NewOrder Price=1.0 OrdQty=100 Side=Buy TraderID=1" LN;
+  env << "NewOrder Price=1.0 OrdQty=40 Side=Sell TraderID=2" LN;
+  env << "NewOrder Price=1.0 OrdQty=40 Side=Sell TraderID=2" LN;
+  auto &book = *env.orderBook();
+  ASSERT_EQ(book.orderToAck().count(), 3);
+  // only the two sells traded on arrival
+  ASSERT_EQ(book.orderToFirstFill().count(), 2);
+  ASSERT_GT(book.orderToAck().max(), 0);
+}
+
+TEST(SpscRing, preserves_order_across_threads) {
+  SpscRing<int> ring(64);
+  const int count = 100000;
+  std::thread producer([&ring] {
+    for (int i(0); i < count; i++) {
+      while (not ring.tryPush(i))
+        std::this_thread::yield();
+    }
+  });
+  int expected(0);
+  int batch[16];
+  while (expected < count) {
+    size_t popped = ring.popBatch(batch, 16);
+    if (popped == 0)
+      std::this_thread::yield();
+    for (size_t i(0); i < popped; i++)
+      ASSERT_EQ(batch[i], expected++);
+  }
+  producer.join();
+  ASSERT_TRUE(ring.empty());
+}
+
+TEST(OrderBook, aggressive_order_matches_before_resting) {
+  TestEnv env("XYZ", 50.32);
+  env << "NewOrder Price=50.0 OrdQty=100 Side=Sell TraderID=1" LN;
+  env >> "ExecReport ExecType=New OrdStatus=New Price=50.0 Side=Sell "
+         "OrdQty=100 LastQty=0 CumQty=0 LastPrice=0 OrderID=1" LN;
+  // fills on arrival, without waiting for any background thread
+  Order order(Side::Buy, 150, 50.1);
+  order.settraderID(2);
+  env.orderBook()->onOrderSingle(order);
+  ASSERT_EQ(env.orderBook()->tradedVolume(), 100);
+  ASSERT_EQ(env.orderBook()->qtyAtLevel(Side::Sell, 50.0), 0);
+  ASSERT_EQ(env.orderBook()->qtyAtLevel(Side::Buy, 50.1), 50);
+  env >> "ExecReport ExecType=New OrdStatus=New Price=50.1 Side=Buy "
+         "OrdQty=150 LastQty=0 CumQty=0 LastPrice=0 OrderID=2" LN;
+  env >> "ExecReport ExecType=Trade OrdStatus=Filled Price=50.0 OrdQty=100 "
+         "LastQty=100 CumQty=100 OrderID=1" LN;
+  env >> "ExecReport ExecType=Trade OrdStatus=PartiallyFilled Price=50.1 "
+         "OrdQty=150 LastQty=100 CumQty=100 OrderID=2" LN;
+  env >> "NONE" LN;
+}
+
+TEST(OrderBook, aggressive_order_sweeps_several_levels) {
+  TestEnv env("XYZ", 50.32);
+  env << "NewOrder Price=50.2 OrdQty=10 Side=Buy TraderID=1" LN;
+  env << "NewOrder Price=50.1 OrdQty=20 Side=Buy TraderID=2" LN;
+  env << "NewOrder Price=50.1 OrdQty=30 Side=Buy TraderID=3" LN;
+  env << "NewOrder Price=50.0 OrdQty=40 Side=Buy TraderID=4" LN;
+  for (int i(1); i <= 4; i++)
+    ASSERT_EQ(env.orderBook()->getExecMessage()->orderID(), i);
+
+  env << "NewOrder Price=50.0 OrdQty=55 Side=Sell TraderID=5" LN;
+  env >> "ExecReport ExecType=New OrdStatus=New Price=50.0 Side=Sell "
+         "OrdQty=55 LastQty=0 CumQty=0 LastPrice=0 OrderID=5" LN;
+  env >> "ExecReport ExecType=Trade OrdStatus=PartiallyFilled Price=50.0 "
+         "OrdQty=55 LastQty=10 CumQty=10 OrderID=5" LN;
+  env >> "ExecReport ExecType=Trade OrdStatus=Filled Price=50.2 OrdQty=10 "
+         "LastQty=10 CumQty=10 OrderID=1" LN;
+  env >> "ExecReport ExecType=Trade OrdStatus=PartiallyFilled Price=50.0 "
+         "OrdQty=55 LastQty=20 CumQty=30 OrderID=5" LN;
+  env >> "ExecReport ExecType=Trade OrdStatus=Filled Price=50.1 OrdQty=20 "
+         "LastQty=20 CumQty=20 OrderID=2" LN;
+  env >> "ExecReport ExecType=Trade OrdStatus=Filled Price=50.0 OrdQty=55 "
+         "LastQty=25 CumQty=55 OrderID=5" LN;
+  env >> "ExecReport ExecType=Trade OrdStatus=PartiallyFilled Price=50.1 "
+         "OrdQty=30 LastQty=25 CumQty=25 OrderID=3" LN;
+  env >> "NONE" LN;
+  ASSERT_EQ(env.orderBook()->qtyAtLevel(Side::Buy, 50.2), 0);
+  ASSERT_EQ(env.orderBook()->qtyAtLevel(Side::Buy, 50.1), 5);
+  ASSERT_EQ(env.orderBook()->qtyAtLevel(Side::Buy, 50.0), 40);
+  ASSERT_EQ(env.orderBook()->bestBid(), 50.1);
+  ASSERT_EQ(env.orderBook()->bestAsk(), -1);
+  ASSERT_EQ(env.orderBook()->tradedVolume(), 55);
+}
+
+TEST(OrderBook, depth_feed_publishes_every_level_change) {
+  BookConfig config;
+  config.depthFeedMode = DepthFeedMode::Incremental;
+  TestEnv env("XYZ", 1.0, config);
+  env << "NewOrder Price=1.0 OrdQty=100 Side=Buy TraderID=1" LN;
+  env << "NewOrder Price=1.0 OrdQty=50 Side=Buy TraderID=1" LN;
+  env << "NewOrder Price=1.0 OrdQty=120 Side=Sell TraderID=2" LN;
+
+  LevelUpdate updates[8];
+  DepthFeed &feed = *env.orderBook()->depthFeed();
+  ASSERT_EQ(feed.poll(updates, 8), 3);
+  ASSERT_EQ(updates[0].qty, 100);
+  ASSERT_EQ(updates[0].count, 1);
+  ASSERT_EQ(updates[1].qty, 150);
+  ASSERT_EQ(updates[1].count, 2);
+  // the sell filled completely on arrival and never rested
+  ASSERT_EQ(updates[2].side, Side::Buy);
+  ASSERT_EQ(updates[2].price, 1.0);
+  ASSERT_EQ(updates[2].qty, 30);
+  ASSERT_EQ(updates[2].count, 1);
+  ASSERT_EQ(updates[2].sequence, 3);
+  ASSERT_EQ(feed.dropped(), 0);
+}
+
+TEST(OrderBook, conflated_depth_feed_keeps_latest_state_per_level) {
+  BookConfig config;
+  config.depthFeedMode = DepthFeedMode::Conflated;
+  TestEnv env("XYZ", 1.0, config);
+  for (int i(0); i < 10; i++)
+    env << "NewOrder Price=0.99 OrdQty=10 Side=Buy TraderID=1" LN;
+  env << "NewOrder Price=1.0 OrdQty=5 Side=Buy TraderID=1" LN;
+  env << "NewOrder Price=1.02 OrdQty=7 Side=Sell TraderID=2" LN;
+
+  DepthFeed &feed = *env.orderBook()->depthFeed();
+  auto snapshot = feed.snapshot(5);
+  ASSERT_EQ(snapshot.bids.size(), 2);
+  ASSERT_EQ(snapshot.bids[0].price, 1.0);
+  ASSERT_EQ(snapshot.bids[1].qty, 100);
+  ASSERT_EQ(snapshot.bids[1].count, 10);
+  ASSERT_EQ(snapshot.asks.size(), 1);
+  ASSERT_EQ(snapshot.asks[0].qty, 7);
+
+  LevelUpdate updates[16];
+  ASSERT_EQ(feed.poll(updates, 16), 3);
+  ASSERT_EQ(updates[0].price, 0.99);
+  ASSERT_EQ(updates[0].qty, 100);
+  ASSERT_EQ(feed.poll(updates, 16), 0);
+}
+
+static std::vector<OrderBook::Command> makeBatch(size_t count_) {
+  std::mt19937 random(5);
+  std::vector<OrderBook::Command> batch;
+  for (size_t i(0); i < count_; i++) {
+    Side side = random() % 2 ? Side::Buy : Side::Sell;
+    if (i > 4 && random() % 3 == 0) {
+      // cancel or amend down an earlier order
+      Order request(side, random() % 2 ? 0 : random() % 50, 50.0);
+      request.settraderID(1);
+      request.setorderID(1 + random() % i);
+      batch.push_back({CommandType::CancelOrder, request});
+      continue;
+    }
+    Order order(side, 1 + random() % 100, 49.95 + 0.01 * (random() % 11));
+    order.settraderID(1);
+    batch.push_back({CommandType::NewOrder, order});
+  }
+  return batch;
+}
+
+static std::vector<ExecReport> drainAll(OrderBook &book_) {
+  std::vector<ExecReport> reports;
+  while (auto report = book_.getExecMessage())
+    reports.push_back(*report);
+  return reports;
+}
+
+TEST(OrderBook, batch_matches_the_same_requests_sent_one_by_one) {
+  auto batch = makeBatch(80);
+  OrderBook single("XYZ", 50.0);
+  for (auto command : batch) {
+    if (command.type == CommandType::NewOrder)
+      single.onOrderSingle(command.order);
+    else
+      single.onOrderCancelRequest(command.order);
+  }
+  auto expected = drainAll(single);
+
+  OrderBook batched("XYZ", 50.0);
+  ASSERT_EQ(batched.onOrderBatch(batch.data(), batch.size()), batch.size());
+  // new orders learn their IDs as with onOrderSingle
+  ASSERT_EQ(batch[0].order.orderID(), 1);
+  auto actual = drainAll(batched);
+  ASSERT_EQ(actual.size(), expected.size());
+  for (size_t i(0); i < expected.size(); i++) {
+    ASSERT_EQ(actual[i].execID(), expected[i].execID());
+    ASSERT_EQ(actual[i].execType(), expected[i].execType());
+    ASSERT_EQ(actual[i].orderID(), expected[i].orderID());
+    ASSERT_EQ(actual[i].cumQty(), expected[i].cumQty());
+    ASSERT_STREQ(actual[i].text(), expected[i].text());
+  }
+  ASSERT_EQ(batched.tradedVolume(), single.tradedVolume());
+
+  // Async queues what fits in one claim, the rest is resubmitted
+  BookConfig config;
+  config.matchingMode = MatchingMode::Async;
+  config.maxPendingCommands = 16;
+  OrderBook async("XYZ", 50.0, config);
+  batch = makeBatch(80);
+  ASSERT_EQ(async.onOrderBatch(batch.data(), batch.size()), 16);
+  async.start();
+  for (size_t sent(16); sent < batch.size();)
+    sent += async.onOrderBatch(batch.data() + sent, batch.size() - sent);
+  async.stop();
+  actual = drainAll(async);
+  ASSERT_EQ(actual.size(), expected.size());
+  for (size_t i(0); i < expected.size(); i++)
+    ASSERT_EQ(actual[i].execType(), expected[i].execType());
+}
+
+TEST(OrderBook, auction_uncrosses_at_the_max_volume_price) {
+  BookConfig config;
+  config.orderFeedCapacity = 1024;
+  OrderBook book("XYZ", 50.0, config);
+  auto send = [&book](Side side_, qty_t qty_, price_t price_) {
+    Order order(side_, qty_, price_);
+    order.settraderID(1);
+    book.onOrderSingle(order);
+    return order.orderID();
+  };
+  ASSERT_TRUE(book.startAuction());
+  ASSERT_EQ(book.phase(), TradingPhase::Auction);
+  send(Side::Buy, 100, 50.05);
+  send(Side::Buy, 100, 50.03);
+  send(Side::Buy, 200, 50.01);
+  send(Side::Sell, 150, 49.99);
+  send(Side::Sell, 100, 50.02);
+  send(Side::Sell, 100, 50.04);
+  int cancelled = send(Side::Sell, 500, 49.98);
+  Order cancel(Side::Sell, 0, 0);
+  cancel.setorderID(cancelled);
+  cancel.settraderID(1);
+  book.onOrderCancelRequest(cancel);
+  // crossing orders rest untouched until the uncross
+  ASSERT_EQ(book.tradedVolume(), 0);
+  ASSERT_EQ(book.bestBid(), 50.05);
+  ASSERT_EQ(book.bestAsk(), 49.99);
+
+  // 200 trade at either 50.02 or 50.03 with 50 sell left over, 50.02 is
+  // nearer the close
+  auto indicative = book.indicativeUncross();
+  ASSERT_EQ(indicative.volume, 200);
+  ASSERT_EQ(indicative.imbalance, -50);
+  ASSERT_EQ(indicative.price, 50.02);
+  drainAll(book);
+  ASSERT_TRUE(book.uncross());
+  ASSERT_EQ(book.phase(), TradingPhase::Continuous);
+  ASSERT_EQ(book.tradedVolume(), 200);
+  auto reports = drainAll(book);
+  // the phase report leads and carries the uncross
+  ASSERT_EQ(reports.front().execType(), ExecType::Phase);
+  ASSERT_STREQ(reports.front().text(), ExecText::AuctionUncrossed);
+  ASSERT_EQ(reports.front().lastPrice(), 50.02);
+  ASSERT_EQ(reports.front().lastQty(), 200);
+  reports.erase(reports.begin());
+  qty_t bought(0);
+  for (auto &report : reports) {
+    ASSERT_EQ(report.execType(), ExecType::Trade);
+    ASSERT_EQ(report.lastPrice(), 50.02);
+    if (report.side() == Side::Buy)
+      bought += report.lastQty();
+  }
+  ASSERT_EQ(bought, 200);
+  ASSERT_EQ(book.bestBid(), 50.01);
+  ASSERT_EQ(book.bestAsk(), 50.02);
+  ASSERT_EQ(book.qtyAtLevel(Side::Sell, 50.02), 50);
+  ASSERT_EQ(book.qtyAtLevel(Side::Buy, 50.03), 0);
+  ASSERT_EQ(book.qtyAtLevel(Side::Sell, 49.99), 0);
+  ASSERT_EQ(book.indicativeUncross().volume, 0);
+
+  // the order feed shows both sides of every auction fill
+  BookBuilder builder;
+  OrderEvent events[64];
+  size_t count;
+  while ((count = book.orderFeed()->poll(events, 64)) > 0)
+    for (size_t i(0); i < count; i++)
+      builder.apply(events[i]);
+  ASSERT_TRUE(builder.inSync());
+  for (ticks_t ticks(4998); ticks <= 5005; ticks++) {
+    ASSERT_EQ(builder.qtyAt(Side::Buy, ticks),
+              book.qtyAtLevel(Side::Buy, ticks / 100.0));
+    ASSERT_EQ(builder.qtyAt(Side::Sell, ticks),
+              book.qtyAtLevel(Side::Sell, ticks / 100.0));
+  }
+
+  // back to continuous matching
+  send(Side::Buy, 20, 50.02);
+  ASSERT_EQ(book.tradedVolume(), 220);
+}
+
+TEST(OrderBook, sparse_ladder_trades_like_a_dense_one) {
+  for (DepthFeedMode mode :
+       {DepthFeedMode::Incremental, DepthFeedMode::Conflated}) {
+    BookConfig config;
+    config.priceBand = 0;
+    config.maxOrders = 8192;
+    config.depthFeedMode = mode;
+    // a window covering every price the flow sends
+    config.ladderWindow = 8192;
+    OrderBook dense("XYZ", 50.0, config);
+    config.ladderWindow = 64;
+    OrderBook sparse("XYZ", 50.0, config);
+    // levels as the sparse book's depth feed has them
+    std::map<std::pair<Side, ticks_t>, qty_t> feedLevels;
+    auto pollFeed = [&]() {
+      LevelUpdate updates[256];
+      while (size_t count = sparse.depthFeed()->poll(updates, 256))
+        for (size_t i(0); i < count; i++)
+          feedLevels[{updates[i].side, updates[i].ticks}] = updates[i].qty;
+    };
+    std::mt19937 random(17);
+    // the market drifts well past the window, some orders land far from it
+    ticks_t mid(5000);
+    for (int i(0); i < 5000; i++) {
+      Order order(Side::Buy, 0, 0);
+      order.settraderID(i % 1000);
+      if (i > 10 && random() % 4 == 0) {
+        order.setorderID(1 + random() % i);
+        order.setordQty(random() % 2 ? 0 : random() % 50);
+        dense.onOrderCancelRequest(order);
+        sparse.onOrderCancelRequest(order);
+      } else {
+        mid = std::clamp<ticks_t>(mid + random() % 9 - 4, 3000, 7000);
+        Side side = random() % 2 ? Side::Buy : Side::Sell;
+        ticks_t spread = random() % 10 == 0 ? 1500 : 30;
+        ticks_t ticks = mid + (side == Side::Buy ? -1 : 1) *
+                                  (static_cast<ticks_t>(random() % spread) - 5);
+        order = Order(side, 1 + random() % 100, ticks / 100.0);
+        order.settraderID(i % 1000);
+        dense.onOrderSingle(order);
+        sparse.onOrderSingle(order);
+      }
+      auto expected = drainAll(dense);
+      auto reports = drainAll(sparse);
+      ASSERT_EQ(reports.size(), expected.size());
+      for (size_t r(0); r < reports.size(); r++) {
+        ASSERT_EQ(reports[r].execType(), expected[r].execType());
+        ASSERT_EQ(reports[r].orderID(), expected[r].orderID());
+        ASSERT_EQ(reports[r].lastQty(), expected[r].lastQty());
+        ASSERT_EQ(reports[r].lastPrice(), expected[r].lastPrice());
+      }
+      ASSERT_EQ(sparse.bestBid(), dense.bestBid());
+      ASSERT_EQ(sparse.bestAsk(), dense.bestAsk());
+      if (i % 100 == 0)
+        pollFeed();
+    }
+    pollFeed();
+    ASSERT_EQ(sparse.depthFeed()->dropped(), 0);
+    ASSERT_EQ(sparse.farLevelNodes().heapAllocations(), 0);
+    ASSERT_EQ(sparse.tradedVolume(), dense.tradedVolume());
+    for (ticks_t ticks(0); ticks <= 9000; ticks++) {
+      for (Side side : {Side::Buy, Side::Sell}) {
+        qty_t qty = dense.qtyAtLevel(side, ticks / 100.0);
+        ASSERT_EQ(sparse.qtyAtLevel(side, ticks / 100.0), qty) << ticks;
+        auto level = feedLevels.find({side, ticks});
+        ASSERT_EQ(level == feedLevels.end() ? 0 : level->second, qty)
+            << ticks;
+      }
+    }
+    auto expected = dense.depthFeed()->snapshot(10);
+    auto snapshot = sparse.depthFeed()->snapshot(10);
+    ASSERT_EQ(snapshot.bids.size(), expected.bids.size());
+    ASSERT_EQ(snapshot.asks.size(), expected.asks.size());
+    for (size_t i(0); i < snapshot.bids.size(); i++) {
+      ASSERT_EQ(snapshot.bids[i].ticks, expected.bids[i].ticks);
+      ASSERT_EQ(snapshot.bids[i].qty, expected.bids[i].qty);
+    }
+    for (size_t i(0); i < snapshot.asks.size(); i++) {
+      ASSERT_EQ(snapshot.asks[i].ticks, expected.asks[i].ticks);
+      ASSERT_EQ(snapshot.asks[i].qty, expected.asks[i].qty);
+    }
+  }
+}
+
+TEST(OrderBook, book_builder_rebuilds_book_from_order_feed) {
+  BookConfig config;
+  config.orderFeedCapacity = 4096;
+  OrderBook book("XYZ", 50.0, config);
+  std::mt19937 random(11);
+  for (int i(0); i < 400; i++) {
+    Side side = random() % 2 ? Side::Buy : Side::Sell;
+    if (i > 10 && random() % 4 == 0) {
+      // cancel or amend down something that may still be resting
+      Order request(side, random() % 3 ? 0 : random() % 50, 50.0);
+      request.settraderID(1);
+      request.setorderID(1 + random() % i);
+      book.onOrderCancelRequest(request);
+      continue;
+    }
+    Order order(side, 1 + random() % 100, 49.9 + 0.01 * (random() % 21));
+    order.settraderID(1);
+    book.onOrderSingle(order);
+  }
+
+  BookBuilder builder;
+  OrderEvent events[256];
+  size_t count;
+  while ((count = book.orderFeed()->poll(events, 256)) > 0)
+    for (size_t i(0); i < count; i++)
+      builder.apply(events[i]);
+  ASSERT_TRUE(builder.inSync());
+  ASSERT_EQ(builder.orderCount(), book.orderPool().size());
+  for (ticks_t ticks(4990); ticks <= 5010; ticks++) {
+    ASSERT_EQ(builder.qtyAt(Side::Buy, ticks),
+              book.qtyAtLevel(Side::Buy, ticks / 100.0));
+    ASSERT_EQ(builder.qtyAt(Side::Sell, ticks),
+              book.qtyAtLevel(Side::Sell, ticks / 100.0));
+  }
+  ASSERT_EQ(builder.bestBid() / 100.0, book.bestBid());
+  ASSERT_EQ(builder.bestAsk() / 100.0, book.bestAsk());
+  book.stop();
+}
+
+TEST(OrderBook, book_builder_detects_dropped_events) {
+  BookConfig config;
+  config.orderFeedCapacity = 4;
+  OrderBook book("XYZ", 50.0, config);
+  for (int i(0); i < 10; i++) {
+    Order order(Side::Buy, 10, 49.9 + 0.01 * i);
+    order.settraderID(1);
+    book.onOrderSingle(order);
+  }
+  ASSERT_EQ(book.orderFeed()->dropped(), 6);
+  Order late(Side::Buy, 10, 50.0);
+  late.settraderID(1);
+  BookBuilder builder;
+  OrderEvent events[8];
+  size_t count = book.orderFeed()->poll(events, 8);
+  book.onOrderSingle(late);
+  count += book.orderFeed()->poll(events + count, 8 - count);
+  ASSERT_EQ(count, 5);
+  for (size_t i(0); i < count; i++)
+    builder.apply(events[i]);
+  ASSERT_FALSE(builder.inSync());
+  ASSERT_EQ(builder.sequence(), 11);
+}
+
+TEST(OrderBook, async_mode_matches_on_engine_thread) {
+  for (auto strategy :
+       {WaitStrategy::Spin, WaitStrategy::SpinYield, WaitStrategy::Block}) {
+    BookConfig config;
+    config.matchingMode = MatchingMode::Async;
+    config.waitStrategy = strategy;
+    TestEnv env("XYZ", 1.0, config);
+    env << "NewOrder Price=1.0 OrdQty=100 Side=Buy TraderID=1" LN;
+    env >> "ExecReport ExecType=New OrdStatus=New Price=1.0 Side=Buy "
+           "OrdQty=100 LastQty=0 CumQty=0 LastPrice=0 OrderID=1" LN;
+    env << "NewOrder Price=1.0 OrdQty=100 Side=Sell TraderID=2" LN;
+    env >> "ExecReport ExecType=New OrdStatus=New Price=1.0 Side=Sell "
+           "OrdQty=100 LastQty=0 CumQty=0 LastPrice=0 OrderID=2" LN;
+    env >> "ExecReport ExecType=Trade OrdStatus=Filled Price=1.0 OrdQty=100 "
+           "LastQty=100 CumQty=100 LastPrice=1.0 OrderID=2" LN;
+    env >> "ExecReport ExecType=Trade OrdStatus=Filled Price=1.0 OrdQty=100 "
+           "LastQty=100 CumQty=100 LastPrice=1.0 OrderID=1" LN;
+    env << "NewOrder Price=1.0 OrdQty=10 Side=Buy TraderID=1" LN;
+    env << "CancelOrder OrdQty=0 OrderID=3 Price=1.0 Side=Buy TraderID=1" LN;
+    env >> "ExecReport ExecType=New OrdStatus=New Price=1.0 Side=Buy "
+           "OrdQty=10 LastQty=0 CumQty=0 LastPrice=0 OrderID=3" LN;
+    env >> "ExecReport ExecType=Cancel OrdStatus=Cancelled Price=1.0 "
+           "OrdQty=10 LastQty=0 CumQty=0 OrderID=3" LN;
+    env >> "NONE" LN;
+  }
+}
+
+TEST(ExecWriter, journals_every_report_with_group_commit) {
+  auto book = std::make_shared<OrderBook>("XYZ", 50.32);
+  JournalConfig config;
+  config.path = testing::TempDir() + "exec_writer_test.log";
+  std::remove(config.path.c_str());
+  config.drainBatch = 4;
+  config.durability = Durability::EveryBatch;
+  ExecWriter writer(book, config);
+  for (int i(0); i < 10; i++) {
+    Order order(Side::Buy, 10, 50.0);
+    order.settraderID(i);
+    book->onOrderSingle(order);
+  }
+  writer.start();
+  writer.stop();
+  ASSERT_EQ(writer.written(), 10);
+  ASSERT_GE(writer.syncs(), 1);
+  ASSERT_EQ(writer.reportToJournal().count(), 10);
+
+  std::ifstream journal(config.path);
+  std::string line;
+  int lines(0);
+  while (std::getline(journal, line)) {
+    ASSERT_NE(line.find("ExecType=New "), std::string::npos) << line;
+    ASSERT_NE(line.find("OrderID=" + std::to_string(++lines) + " "),
+              std::string::npos)
+        << line;
+  }
+  ASSERT_EQ(lines, 10);
+}
+
+TEST(ExecWriter, failed_writes_stay_buffered_and_are_never_synced) {
+  // every write to /dev/full fails with no space left
+  JournalFile file("/dev/full", 64);
+  ASSERT_TRUE(file.isOpen());
+  ASSERT_EQ(file.sputn("ExecType=New\n", 13), 13);
+  ASSERT_FALSE(file.flush());
+  ASSERT_EQ(file.buffered(), 13);
+  ASSERT_FALSE(file.syncToDisk());
+  ASSERT_EQ(file.buffered(), 13);
+
+  auto book = std::make_shared<OrderBook>("XYZ", 50.32);
+  JournalConfig config;
+  config.path = "/dev/full";
+  config.bufferSize = 256;
+  config.durability = Durability::EveryBatch;
+  ExecWriter writer(book, config);
+  for (int i(0); i < 10; i++) {
+    Order order(Side::Buy, 10, 50.0);
+    order.settraderID(i);
+    book->onOrderSingle(order);
+  }
+  writer.start();
+  writer.stop();
+  ASSERT_EQ(writer.written(), 10);
+  ASSERT_GT(writer.failures(), 0);
+  ASSERT_EQ(writer.syncs(), 0);
+}
+
+TEST(ExecWriter, binary_journal_decodes_to_the_same_reports) {
+  auto book = std::make_shared<OrderBook>("XYZ", 50.32);
+  JournalConfig config;
+  config.path = testing::TempDir() + "exec_writer_test.bin";
+  config.format = JournalFormat::Binary;
+  std::remove(config.path.c_str());
+  ExecWriter writer(book, config);
+  Order buy(Side::Buy, 100, 50.33);
+  buy.settraderID(1);
+  book->onOrderSingle(buy);
+  Order sell(Side::Sell, 40, 50.31);
+  sell.settraderID(2);
+  book->onOrderSingle(sell);
+  Order offBand(Side::Sell, 40, 70.0);
+  offBand.settraderID(2);
+  book->onOrderSingle(offBand);
+  writer.start();
+  writer.stop();
+  ASSERT_EQ(writer.written(), 5);
+
+  std::ifstream journal(config.path, std::ios::binary);
+  JournalHeader header;
+  ASSERT_TRUE(journal.read(reinterpret_cast<char *>(&header), sizeof(header)));
+  ASSERT_TRUE(header.isValid());
+  ASSERT_STREQ(header.symbol, "XYZ");
+  std::vector<ExecReport> reports;
+  ExecRecord record;
+  while (journal.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+    ASSERT_EQ(record.sequence, reports.size() + 1);
+    reports.push_back(record.decode(header.ticksPerUnit));
+  }
+  ASSERT_EQ(reports.size(), 5);
+  ASSERT_EQ(reports[2].execType(), ExecType::Trade);
+  ASSERT_EQ(reports[2].ordStatus(), OrdStatus::Filled);
+  ASSERT_EQ(reports[2].orderID(), 2);
+  ASSERT_EQ(reports[2].lastQty(), 40);
+  ASSERT_EQ(reports[2].lastPrice(), 50.31);
+  ASSERT_EQ(reports[3].ordStatus(), OrdStatus::PartiallyFilled);
+  ASSERT_EQ(reports[3].price(), 50.33);
+  ASSERT_EQ(reports[3].cumQty(), 40);
+  ASSERT_EQ(reports[4].execType(), ExecType::Reject);
+  ASSERT_STREQ(reports[4].text(), ExecText::PriceOutsideThreshold);
+}
+
+TEST(OrderFlow, text_and_binary_flows_replay_the_same) {
+  std::string textPath = testing::TempDir() + "order_flow_test.txt";
+  std::string binaryPath = testing::TempDir() + "order_flow_test.bin";
+  {
+    std::ofstream text(textPath);
+    text << "# recorded flow\n"
+            "NewOrder Side=Buy Price=50.30 OrdQty=100 TraderID=1\n"
+            "\n"
+            "NewOrder Side=Sell Price=50.35 OrdQty=50 TraderID=2\n"
+            "CancelOrder OrderID=1 OrdQty=60 TraderID=1\n"
+            "NewOrder Side=Sell Price=50.30 OrdQty=20 TraderID=3\n"
+            "CancelOrder OrderID=2 OrdQty=0 TraderID=2\n";
+  }
+  std::vector<FlowMessage> flow;
+  ASSERT_TRUE(readFlow(textPath, FlowFormat::Text, flow));
+  ASSERT_EQ(flow.size(), 5);
+  ASSERT_EQ(flow[2].type, CommandType::CancelOrder);
+  ASSERT_EQ(flow[2].order.orderID(), 1);
+  ASSERT_EQ(flow[2].order.ordQty(), 60);
+
+  ASSERT_TRUE(writeBinaryFlow(binaryPath, flow));
+  std::vector<FlowMessage> decoded;
+  ASSERT_TRUE(readFlow(binaryPath, FlowFormat::Binary, decoded));
+  ASSERT_EQ(decoded.size(), flow.size());
+  for (size_t i(0); i < flow.size(); i++) {
+    ASSERT_EQ(decoded[i].type, flow[i].type);
+    ASSERT_EQ(decoded[i].order.side(), flow[i].order.side());
+    ASSERT_EQ(decoded[i].order.price(), flow[i].order.price());
+    ASSERT_EQ(decoded[i].order.ordQty(), flow[i].order.ordQty());
+    ASSERT_EQ(decoded[i].order.traderID(), flow[i].order.traderID());
+  }
+
+  OrderBook book("XYZ", 50.32);
+  FlowReplay replay(decoded);
+  replay.run(book);
+  ASSERT_EQ(replay.submitLatency().count(), 5);
+  ASSERT_EQ(book.tradedVolume(), 20);
+  ASSERT_EQ(book.qtyAtLevel(Side::Buy, 50.30), 40);
+  ASSERT_EQ(book.qtyAtLevel(Side::Sell, 50.35), 0);
+
+  std::ofstream(textPath) << "NewOrder Side=Buy Price=abc OrdQty=1\n";
+  ASSERT_FALSE(readFlow(textPath, FlowFormat::Text, flow));
+  ASSERT_FALSE(readFlow(textPath, FlowFormat::Binary, flow));
+}
+
+static void expectSameState(const BookSnapshot &expected_,
+                            const BookSnapshot &actual_) {
+  ASSERT_EQ(actual_.header.sequence, expected_.header.sequence);
+  ASSERT_EQ(actual_.header.oidSeed, expected_.header.oidSeed);
+  ASSERT_EQ(actual_.header.tradedVolume, expected_.header.tradedVolume);
+  ASSERT_EQ(actual_.header.phase, expected_.header.phase);
+  ASSERT_EQ(actual_.orders.size(), expected_.orders.size());
+  for (size_t i(0); i < expected_.orders.size(); i++)
+    ASSERT_EQ(std::memcmp(&actual_.orders[i], &expected_.orders[i],
+                          sizeof(SnapshotOrder)),
+              0)
+        << "order " << expected_.orders[i].orderID;
+  std::set<int> expectedTraders(expected_.traders.begin(),
+                                expected_.traders.end());
+  std::set<int> actualTraders(actual_.traders.begin(), actual_.traders.end());
+  ASSERT_EQ(actualTraders, expectedTraders);
+}
+
+TEST(Snapshot, recovers_the_exact_book_from_snapshot_and_journal) {
+  std::string snapshotPath = testing::TempDir() + "snapshot_test.snapshot";
+  JournalConfig journalConfig;
+  journalConfig.path = testing::TempDir() + "snapshot_test.bin";
+  journalConfig.format = JournalFormat::Binary;
+  std::remove(snapshotPath.c_str());
+  std::remove(journalConfig.path.c_str());
+
+  auto book = std::make_shared<OrderBook>("XYZ", 50.32);
+  ExecWriter writer(book, journalConfig);
+  writer.start();
+  std::mt19937 random(7);
+  BookSnapshot midway;
+  int sent(0);
+  for (int i(0); i < 4000; i++) {
+    if (i == 2000) {
+      ASSERT_TRUE(book->requestSnapshot(&midway));
+    }
+    if (sent > 0 && random() % 3 == 0) {
+      Order cancel(Side::Buy, random() % 2 ? 0 : random() % 50, 0);
+      cancel.setorderID(1 + random() % sent);
+      cancel.settraderID(random() % 200);
+      book->onOrderCancelRequest(cancel);
+    } else {
+      Side side = random() % 2 ? Side::Buy : Side::Sell;
+      price_t price = 50.32 + (static_cast<int>(random() % 41) - 20) / 100.0;
+      Order order(side, 1 + random() % 100, price);
+      order.settraderID(random() % 200);
+      book->onOrderSingle(order);
+      ++sent;
+    }
+  }
+  // taken by the writer at the next request boundary
+  ASSERT_EQ(book->snapshotsTaken(), 1);
+  ASSERT_GT(midway.header.sequence, 0);
+  ASSERT_GT(midway.orders.size(), 0);
+  ASSERT_TRUE(midway.save(snapshotPath));
+  writer.stop();
+  BookSnapshot expected;
+  book->captureSnapshot(expected);
+  ASSERT_GT(expected.header.tradedVolume, 0);
+
+  OrderBook fromSnapshot("XYZ", 50.32);
+  ASSERT_TRUE(recoverBook(fromSnapshot, snapshotPath, journalConfig.path));
+  BookSnapshot actual;
+  fromSnapshot.captureSnapshot(actual);
+  expectSameState(expected, actual);
+  for (ticks_t ticks(5012); ticks <= 5052; ticks++) {
+    ASSERT_EQ(fromSnapshot.qtyAtLevel(Side::Buy, ticks / 100.0),
+              book->qtyAtLevel(Side::Buy, ticks / 100.0));
+    ASSERT_EQ(fromSnapshot.qtyAtLevel(Side::Sell, ticks / 100.0),
+              book->qtyAtLevel(Side::Sell, ticks / 100.0));
+  }
+
+  OrderBook fromJournal("XYZ", 50.32);
+  ASSERT_TRUE(recoverBook(fromJournal, snapshotPath + ".missing",
+                          journalConfig.path));
+  fromJournal.captureSnapshot(actual);
+  expectSameState(expected, actual);
+
+  // carries on numbering where the original left off
+  Order next(Side::Buy, 10, 50.0);
+  next.settraderID(1);
+  fromSnapshot.onOrderSingle(next);
+  ASSERT_EQ(next.orderID(), expected.header.oidSeed + 1);
+  ASSERT_EQ(fromSnapshot.getExecMessage()->execID(),
+            static_cast<int>(expected.header.sequence) + 1);
+
+  OrderBook otherBook("ABC", 50.32);
+  ASSERT_FALSE(recoverBook(otherBook, snapshotPath, journalConfig.path));
+}
+
+TEST(Snapshot, recovers_the_phase_across_an_auction) {
+  std::string snapshotPath = testing::TempDir() + "auction_test.snapshot";
+  JournalConfig journalConfig;
+  journalConfig.path = testing::TempDir() + "auction_test.bin";
+  journalConfig.format = JournalFormat::Binary;
+  std::remove(snapshotPath.c_str());
+  std::remove(journalConfig.path.c_str());
+
+  auto book = std::make_shared<OrderBook>("XYZ", 50.0);
+  ExecWriter writer(book, journalConfig);
+  writer.start();
+  auto send = [&book](Side side_, qty_t qty_, price_t price_) {
+    Order order(side_, qty_, price_);
+    order.settraderID(1);
+    book->onOrderSingle(order);
+  };
+  send(Side::Buy, 100, 49.95);
+  send(Side::Sell, 100, 50.10);
+  ASSERT_TRUE(book->startAuction());
+  send(Side::Buy, 100, 50.05);
+  send(Side::Sell, 60, 50.00);
+  BookSnapshot midway;
+  ASSERT_TRUE(book->requestSnapshot(&midway));
+  // crosses without trading, and is taken at this request
+  send(Side::Sell, 80, 50.02);
+  ASSERT_EQ(book->snapshotsTaken(), 1);
+  ASSERT_EQ(midway.header.phase,
+            static_cast<uint32_t>(TradingPhase::Auction));
+  ASSERT_TRUE(midway.save(snapshotPath));
+  ASSERT_EQ(book->tradedVolume(), 0);
+  ASSERT_TRUE(book->uncross());
+  ASSERT_EQ(book->tradedVolume(), 100);
+  send(Side::Buy, 10, 50.02);
+  writer.stop();
+  BookSnapshot expected;
+  book->captureSnapshot(expected);
+  ASSERT_EQ(expected.header.phase,
+            static_cast<uint32_t>(TradingPhase::Continuous));
+  ASSERT_EQ(expected.header.tradedVolume, 110);
+
+  // the snapshot alone is still in the auction
+  OrderBook restored("XYZ", 50.0);
+  ASSERT_TRUE(restored.restore(midway));
+  ASSERT_EQ(restored.phase(), TradingPhase::Auction);
+  ASSERT_GT(restored.bestBid(), restored.bestAsk());
+
+  for (bool withSnapshot : {true, false}) {
+    OrderBook recovered("XYZ", 50.0);
+    ASSERT_TRUE(recoverBook(recovered,
+                            withSnapshot ? snapshotPath
+                                         : snapshotPath + ".missing",
+                            journalConfig.path));
+    BookSnapshot actual;
+    recovered.captureSnapshot(actual);
+    expectSameState(expected, actual);
+    ASSERT_EQ(recovered.phase(), TradingPhase::Continuous);
+    ASSERT_EQ(recovered.bestBid(), book->bestBid());
+    ASSERT_EQ(recovered.bestAsk(), book->bestAsk());
+    ASSERT_LT(recovered.bestBid(), recovered.bestAsk());
+  }
+}
+
+TEST(LineFormatter, renders_fields_and_nanosecond_timestamps) {
+  using namespace std::chrono;
+  LineFormatter line;
+  line.field("Side", Side::Sell)
+      .field("Qty", 42L)
+      .field("Price", 50.31)
+      .field("Text", "x");
+  ASSERT_EQ(line.view(), "Side=Sell Qty=42 Price=50.31 Text=x ");
+
+  auto expected = [](std::time_t second_, const char *fraction_) {
+    std::tm local;
+    localtime_r(&second_, &local);
+    char prefix[32];
+    std::strftime(prefix, sizeof(prefix), "%Y-%m-%d:%H:%M:%S", &local);
+    return std::string(prefix) + fraction_;
+  };
+  timestamp_t time(duration_cast<system_clock::duration>(
+      seconds(1700000000) + nanoseconds(123)));
+  line.clear();
+  line.append(time);
+  ASSERT_EQ(line.view(), expected(1700000000, ".000000123"));
+  // crossing into the next second renders a fresh prefix
+  line.clear();
+  line.append(time + seconds(1) + milliseconds(5));
+  ASSERT_EQ(line.view(), expected(1700000001, ".005000123"));
+}
+
+TEST(Logger, formats_captured_arguments_on_the_logger_thread) {
+  LogLine line(LogLevel::Warn, "File.cpp", 12);
+  std::string symbol("XYZ");
+  line << "Book " << LOG_VAR(symbol) << LOG_NVP("Side", Side::Sell)
+       << LOG_NVP("Qty", 42L) << LOG_NVP("Price", 50.25);
+  // the captured copy must not depend on the source string
+  symbol = "ABC";
+  LineFormatter out;
+  line.format(out);
+  auto text = std::string(out.view());
+  ASSERT_NE(text.find(" WARN    Book symbol='XYZ', Side=Sell Qty=42 "
+                      "Price=50.25  |File.cpp:12\n"),
+            std::string::npos)
+      << text;
+
+  LogLine longLine(LogLevel::Info, "File.cpp", 13);
+  longLine << std::string(1000, 'x') << 1;
+  longLine.format(out);
+  ASSERT_NE(std::string(out.view()).find("xxx... |File.cpp:13"),
+            std::string::npos);
+  Logger::instance().flush();
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();